@@ -0,0 +1,146 @@
+#include "Batch.h"
+#include "Content.h"
+#include "Context.h"
+#include "Mapping.h"
+#include <cstring>
+#include <stdexcept>
+
+
+/**
+ * Read the records from a file, all at once for CSV, and just as far as
+ * finding where each line starts for JSON.
+ */
+Batch::Batch(const std::string& filename) : filename(filename),
+	file(Mapping::open(filename)), csv(false) {
+
+	if (!file)
+		throw std::runtime_error("Unable to open records \"" + filename
+			+ "\".");
+
+	csv = filename.size() > 4 && (filename.compare(filename.size() - 4, 4,
+		".csv") == 0 || filename.compare(filename.size() - 4, 4, ".CSV") == 0);
+	if (csv)
+		read_csv();
+	else
+		read_lines();
+
+}
+
+
+std::size_t Batch::size() const {
+	return csv ? rows.size() : lines.size();
+}
+
+
+/**
+ * Define the fields of a record in the current namespace, escaping their
+ * values if there's an escape function. A CSV record that's short of fields
+ * has the rest defined as empty.
+ */
+void Batch::define(std::size_t index, Context& context,
+	Json::Escape escape) const {
+
+	if (!csv) {
+		Json(std::string(file->data() + lines[index].first,
+			lines[index].second)).define(context, escape);
+		return;
+	}
+
+	const std::vector<std::string>& row = rows[index];
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		if (names[i].empty()) continue;
+		const std::string value = i < row.size() ? row[i] : std::string();
+		context.define(Signature(names[i]), Reference<const Expression>
+			(new Content(0, 0, escape ? escape(value) : value)));
+	}
+
+}
+
+
+/**
+ * Find the lines that aren't blank.
+ */
+void Batch::read_lines() {
+	const char* data = file->data();
+	const std::size_t size = file->size();
+	std::size_t begin = 0;
+	while (begin < size) {
+		const void* newline = std::memchr(data + begin, '\n', size - begin);
+		const std::size_t end = newline
+			? static_cast<const char*>(newline) - data : size;
+		std::size_t first = begin;
+		while (first < end && (data[first] == ' ' || data[first] == '\t'
+			|| data[first] == '\r'))
+			++first;
+		if (first < end)
+			lines.push_back({begin, end - begin});
+		begin = end + 1;
+	}
+}
+
+
+/**
+ * Read RFC 4180 CSV: fields separated by commas, optionally in double quotes,
+ * within which a quote is written twice and commas and line breaks are just
+ * text. Lines may end in CRLF or LF, and blank lines are skipped.
+ */
+void Batch::read_csv() {
+
+	const char* data = file->data();
+	const std::size_t size = file->size();
+	std::vector<std::string> row;
+	std::size_t i = 0;
+
+	while (i < size) {
+
+		if (row.empty() && (data[i] == '\n' || data[i] == '\r')) {
+			++i;
+			continue;
+		}
+
+		std::string field;
+		if (data[i] == '"') {
+			++i;
+			while (true) {
+				const void* quote = i < size
+					? std::memchr(data + i, '"', size - i) : nullptr;
+				if (!quote)
+					throw std::runtime_error("Unterminated quoted field in \""
+						+ filename + "\".");
+				const std::size_t end = static_cast<const char*>(quote) - data;
+				field.append(data + i, end - i);
+				i = end + 1;
+				if (i == size || data[i] != '"') break;
+				field += '"';
+				++i;
+			}
+			if (i < size && data[i] != ',' && data[i] != '\n'
+				&& data[i] != '\r')
+				throw std::runtime_error("Expected comma after quoted field "
+					"in \"" + filename + "\".");
+		} else {
+			const std::size_t begin = i;
+			while (i < size && data[i] != ',' && data[i] != '\n'
+				&& data[i] != '\r')
+				++i;
+			field.assign(data + begin, i - begin);
+		}
+		row.push_back(field);
+
+		if (i < size && data[i] == ',') {
+			++i;
+			if (i == size) row.push_back(std::string());
+			else continue;
+		}
+
+		if (i < size && data[i] == '\r') ++i;
+		if (i < size && data[i] == '\n') ++i;
+		if (names.empty())
+			names.swap(row);
+		else
+			rows.push_back(row);
+		row.clear();
+
+	}
+
+}
@@ -0,0 +1,44 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include "Json.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+class Context;
+class Mapping;
+
+
+/**
+ * The records of a batch run, each of which a template is rendered for. They
+ * come from a CSV file, whose first row names the fields, or otherwise from a
+ * file of JSON objects, one to a line. A JSON record is only decoded as its
+ * fields are used, as with a JSON request body.
+ */
+class Batch {
+public:
+
+	explicit Batch(const std::string&);
+
+	std::size_t size() const;
+	void define(std::size_t, Context&, Json::Escape = nullptr) const;
+
+private:
+
+	void read_lines();
+	void read_csv();
+
+	std::string filename;
+	std::shared_ptr<const Mapping> file;
+	std::vector<std::pair<std::size_t, std::size_t>> lines;
+	std::vector<std::string> names;
+	std::vector<std::vector<std::string>> rows;
+	bool csv;
+
+};
+
+
+#endif
@@ -1,4 +1,5 @@
 #include "Block.h"
+#include "Image.h"
 #include "List.h"
 #include <algorithm>
 #include <sstream>
@@ -11,14 +12,14 @@ Block::Block(int line, int column) : Expression(line, column) {}
 
 
 Block::Block(int line, int column,
-	const std::vector<std::shared_ptr<const Expression>>& value) :
+	const std::vector<Reference<const Expression>>& value) :
 	Expression(line, column), value(value) {}
 
 
 Block::~Block() {}
 
 
-void Block::add(std::shared_ptr<const Expression> expression) {
+void Block::add(Reference<const Expression> expression) {
 	value.push_back(expression);
 }
 
@@ -26,11 +27,11 @@ void Block::add(std::shared_ptr<const Expression> expression) {
 /**
  * Evaluate each Expression and yield a List of results.
  */
-std::shared_ptr<const List> Block::evaluate(Context& context) const {
-	std::shared_ptr<List> result(new List(line_number, column_number));
+Reference<const List> Block::evaluate(Context& context) const {
+	Reference<List> result(new List(line_number, column_number));
 	for (auto i = value.begin(); i != value.end(); ++i)
 		result->add((*i)->evaluate(context));
-	return std::static_pointer_cast<const List>(result);
+	return static_reference_cast<const List>(result);
 }
 
 
@@ -52,4 +53,13 @@ double Block::get_data() const {
 }
 
 
+
+void Block::write(Image& image) const {
+	image.write_tag(Image::BLOCK);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_expressions(value);
+}
+
+
 Block* Block::clone() const { return new Block(*this); }
@@ -0,0 +1,78 @@
+#include "Builder.h"
+#include "Image.h"
+#include "List.h"
+#include <cstdlib>
+#include <ostream>
+
+
+Builder::Builder(int line, int column, const std::string& buffer) :
+	Value(line, column), buffer(buffer) {}
+
+
+Builder::~Builder() {}
+
+
+/**
+ * Add the content of a Value to the end. A Builder is the one Value that's
+ * meant to change, so it does so even through a const Reference: everyone who
+ * can see it is supposed to see it grow.
+ */
+void Builder::append(const Value& value) const {
+	if (const List* list = dynamic_cast<const List*>(&value)) {
+		for (std::size_t i = 0; i < list->size(); ++i)
+			buffer += list->at(i)->get_content();
+	} else {
+		buffer += value.get_content();
+	}
+}
+
+
+/**
+ * Take the content built so far, leaving the Builder empty.
+ */
+std::string Builder::finish() const {
+	std::string result;
+	result.swap(buffer);
+	return result;
+}
+
+
+/**
+ * A Builder as a List is a List of just that Builder, so that it can be found
+ * by name.
+ */
+Reference<const List> Builder::evaluate(Context&) const {
+	Reference<List> result(new List(line_number, column_number));
+	result->add(self_reference());
+	return static_reference_cast<const List>(result);
+}
+
+
+std::string Builder::get_content() const {
+	return buffer;
+}
+
+
+double Builder::get_data() const {
+	return std::strtod(buffer.c_str(), nullptr);
+}
+
+
+/**
+ * A Builder is saved with the content it has so far, so that one made in a
+ * prelude is still a Builder, in the same state, when the image is loaded.
+ */
+void Builder::write(Image& image) const {
+	image.write_tag(Image::BUILDER);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_string(buffer);
+}
+
+
+void Builder::write_content(std::ostream& stream) const {
+	stream << buffer;
+}
+
+
+Builder* Builder::clone() const { return new Builder(*this); }
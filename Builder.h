@@ -0,0 +1,39 @@
+#ifndef BUILDER_H
+#define BUILDER_H
+#include "Value.h"
+#include <string>
+
+
+/**
+ * A string that grows in place, for templates that put together a lot of
+ * content a piece at a time. Appending adds to one buffer, rather than making
+ * a new string out of the old one, and finishing hands the buffer over to a
+ * Content whole.
+ */
+class Builder : public Value {
+public:
+
+	Builder(int, int, const std::string& = std::string());
+	virtual ~Builder();
+
+	void append(const Value&) const;
+	std::string finish() const;
+
+	virtual Reference<const List> evaluate(Context&) const;
+	virtual std::string get_content() const;
+	virtual double get_data() const;
+	virtual void write(Image&) const;
+	virtual void write_content(std::ostream&) const;
+
+protected:
+
+	virtual Builder* clone() const;
+
+private:
+
+	mutable std::string buffer;
+
+};
+
+
+#endif
@@ -0,0 +1,367 @@
+#include "Cache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <map>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+	const char magic[8] = {'V', 'I', 'S', 'I', 'O', 'N', 'C', 2};
+	const char statistics[] = "statistics";
+	const std::time_t abandoned = 60 * 60;
+
+	uint64_t rotate(uint64_t x, int bits) {
+		return (x << bits) | (x >> (64 - bits));
+	}
+
+	/**
+	 * A finalizer, to spread every input bit over every output bit.
+	 */
+	uint64_t mix(uint64_t x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return x;
+	}
+
+	/**
+	 * Two independent 64-bit hashes, updated a word at a time.
+	 */
+	struct Hasher {
+
+		Hasher() : state{0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL} {}
+
+		void word(uint64_t value) {
+			state[0] = rotate(state[0] ^ mix(value), 31)
+				* 0x9e3779b97f4a7c15ULL;
+			state[1] = rotate(state[1] + mix(value ^ 0x2545f4914f6cdd1dULL),
+				27) * 0xbf58476d1ce4e5b9ULL;
+		}
+
+		/**
+		 * Hash the length first, so that no two sequences of strings hash
+		 * the same just by moving characters from one to the next.
+		 */
+		void string(const std::string& value) {
+			word(value.size());
+			const char* data = value.data();
+			std::size_t size = value.size();
+			for (; size >= 8; data += 8, size -= 8) {
+				uint64_t chunk;
+				std::memcpy(&chunk, data, 8);
+				word(chunk);
+			}
+			uint64_t tail = 0;
+			std::memcpy(&tail, data, size);
+			word(tail);
+		}
+
+		uint64_t state[2];
+
+	};
+
+	bool read_all(int descriptor, char* data, std::size_t size) {
+		while (size) {
+			const ssize_t result = read(descriptor, data, size);
+			if (result == -1 && errno == EINTR) continue;
+			if (result <= 0) return false;
+			data += result;
+			size -= result;
+		}
+		return true;
+	}
+
+	bool write_all(int descriptor, const char* data, std::size_t size) {
+		while (size) {
+			const ssize_t result = write(descriptor, data, size);
+			if (result == -1 && errno == EINTR) continue;
+			if (result <= 0) return false;
+			data += result;
+			size -= result;
+		}
+		return true;
+	}
+
+	/**
+	 * An entry considered for eviction.
+	 */
+	struct Entry {
+
+		std::time_t modified;
+		uint64_t size;
+		std::string path;
+
+		bool operator<(const Entry& other) const {
+			return modified < other.modified;
+		}
+
+	};
+
+}
+
+
+/**
+ * The directory is created if need be. Failing that, the Cache carries on
+ * and simply misses every time; a cache is no reason to fail a request.
+ */
+Cache::Cache(const std::string& directory, const std::string& version,
+	std::time_t lifetime, uint64_t capacity) : directory(directory),
+	version(version), lifetime(lifetime), capacity(capacity), hits(0),
+	misses(0), stores(0), bytes(0) {
+	mkdir(directory.c_str(), 0700);
+}
+
+
+Cache::~Cache() { flush(); }
+
+
+std::string Cache::Key::filename() const {
+	char result[33];
+	std::snprintf(result, sizeof(result), "%016llx%016llx",
+		(unsigned long long)hash[0], (unsigned long long)hash[1]);
+	return result;
+}
+
+
+/**
+ * Compute the Key for a command and its input under the current version.
+ */
+Cache::Key Cache::key(const std::vector<std::string>& arguments,
+	const std::string& input) const {
+
+	Key result;
+	result.identity = version;
+	for (auto i = arguments.begin(); i != arguments.end(); ++i) {
+		result.identity += '\0';
+		result.identity += *i;
+	}
+	result.input = input;
+
+	Hasher hasher;
+	hasher.string(result.identity);
+	hasher.string(input);
+	result.hash[0] = mix(hasher.state[0] ^ rotate(hasher.state[1], 17));
+	result.hash[1] = mix(hasher.state[1] ^ rotate(hasher.state[0], 43));
+	return result;
+
+}
+
+
+/**
+ * Look up an entry. An entry that's expired, unreadable, or filed under the
+ * right hash for the wrong command counts as a miss.
+ */
+bool Cache::find(const Key& key, std::string& output) {
+	if (load(key, output)) {
+		++hits;
+		return true;
+	}
+	++misses;
+	return false;
+}
+
+
+bool Cache::load(const Key& key, std::string& output) const {
+
+	const std::string path = directory + '/' + key.filename();
+	const int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (descriptor == -1) return false;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0
+		|| (lifetime && std::time(nullptr) - status.st_mtime >= lifetime)) {
+		close(descriptor);
+		return false;
+	}
+
+	std::string data(status.st_size, '\0');
+	const bool readable = read_all(descriptor, &data[0], data.size());
+	close(descriptor);
+	if (!readable) return false;
+
+	uint64_t identity_size;
+	uint64_t input_size;
+	std::size_t offset = sizeof(magic);
+
+	if (data.size() < offset + sizeof(identity_size)
+		|| std::memcmp(data.data(), magic, sizeof(magic)) != 0)
+		return false;
+	std::memcpy(&identity_size, &data[offset], sizeof(identity_size));
+	offset += sizeof(identity_size);
+
+	if (data.size() - offset < identity_size + sizeof(input_size)
+		|| data.compare(offset, identity_size, key.identity) != 0)
+		return false;
+	offset += identity_size;
+	std::memcpy(&input_size, &data[offset], sizeof(input_size));
+	offset += sizeof(input_size);
+
+	if (data.size() - offset < input_size || input_size != key.input.size()
+		|| data.compare(offset, input_size, key.input) != 0)
+		return false;
+	offset += input_size;
+
+	output.assign(data, offset, std::string::npos);
+	return true;
+
+}
+
+
+/**
+ * Add an entry. Concurrent writers of the same entry each rename their own
+ * complete copy into place, and whichever comes last wins.
+ */
+void Cache::store(const Key& key, const std::string& output) {
+
+	std::string temporary = directory + "/.tmp.XXXXXX";
+	const int descriptor = mkstemp(&temporary[0]);
+	if (descriptor == -1) return;
+
+	const uint64_t identity_size = key.identity.size();
+	const uint64_t input_size = key.input.size();
+	std::string header(magic, sizeof(magic));
+	header.append(reinterpret_cast<const char*>(&identity_size),
+		sizeof(identity_size));
+	header += key.identity;
+	header.append(reinterpret_cast<const char*>(&input_size),
+		sizeof(input_size));
+	header += key.input;
+
+	const bool written = write_all(descriptor, header.data(), header.size())
+		&& write_all(descriptor, output.data(), output.size());
+	fchmod(descriptor, 0644);
+
+	if (close(descriptor) != 0 || !written || std::rename(temporary.c_str(),
+		(directory + '/' + key.filename()).c_str()) != 0) {
+		std::remove(temporary.c_str());
+		return;
+	}
+
+	++stores;
+	bytes += header.size() + output.size();
+
+}
+
+
+/**
+ * Add this process's counts to the statistics file. Whoever holds the lock
+ * on it is also responsible for enforcing the size limit, which keeps two
+ * processes from evicting at once.
+ */
+void Cache::flush() {
+
+	if (!hits && !misses && !stores) return;
+
+	const std::string path = directory + '/' + statistics;
+	const int descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+		0644);
+	if (descriptor == -1) return;
+
+	if (flock(descriptor, LOCK_EX) != 0) {
+		close(descriptor);
+		return;
+	}
+
+	std::map<std::string, uint64_t> counts;
+	struct stat status;
+	if (fstat(descriptor, &status) == 0) {
+		std::string data(status.st_size, '\0');
+		if (read_all(descriptor, &data[0], data.size())) {
+			std::istringstream stream(data);
+			std::string name;
+			uint64_t value;
+			while (stream >> name >> value)
+				counts[name] = value;
+		}
+	}
+
+	counts["hits"] += hits;
+	counts["misses"] += misses;
+	counts["stores"] += stores;
+	counts["bytes"] += bytes;
+
+	if (capacity && counts["bytes"] > capacity) {
+		uint64_t evicted = 0;
+		counts["bytes"] = evict(evicted);
+		counts["evictions"] += evicted;
+	}
+
+	std::ostringstream stream;
+	for (auto i = counts.begin(); i != counts.end(); ++i)
+		stream << i->first << ' ' << i->second << '\n';
+	const std::string data = stream.str();
+
+	if (ftruncate(descriptor, 0) == 0 && lseek(descriptor, 0, SEEK_SET) == 0)
+		write_all(descriptor, data.data(), data.size());
+
+	close(descriptor);
+	hits = misses = stores = bytes = 0;
+
+}
+
+
+/**
+ * Delete expired entries, then the oldest entries until the cache is down to
+ * three quarters of its capacity, so that eviction doesn't happen on every
+ * single store. Temporary files left behind by crashed writers are cleaned
+ * up too. Returns the size of what's left.
+ */
+uint64_t Cache::evict(uint64_t& evicted) const {
+
+	DIR* stream = opendir(directory.c_str());
+	if (!stream) return 0;
+
+	const std::time_t now = std::time(nullptr);
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+
+	while (const dirent* entry = readdir(stream)) {
+
+		const std::string name = entry->d_name;
+		if (name == "." || name == ".." || name == statistics) continue;
+
+		const std::string path = directory + '/' + name;
+		struct stat status;
+		if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+			continue;
+
+		if (name[0] == '.') {
+			if (now - status.st_mtime > abandoned)
+				unlink(path.c_str());
+			continue;
+		}
+
+		if (lifetime && now - status.st_mtime >= lifetime) {
+			if (unlink(path.c_str()) == 0) ++evicted;
+			continue;
+		}
+
+		entries.push_back({status.st_mtime, uint64_t(status.st_size), path});
+		total += status.st_size;
+
+	}
+
+	closedir(stream);
+
+	std::sort(entries.begin(), entries.end());
+	for (auto i = entries.begin();
+		i != entries.end() && total > capacity / 4 * 3; ++i) {
+		if (unlink(i->path.c_str()) == 0) {
+			total -= i->size;
+			++evicted;
+		}
+	}
+
+	return total;
+
+}
@@ -0,0 +1,71 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+
+/**
+ * An on-disk cache of the output of external commands, shared between any
+ * number of concurrent Vision processes. Each entry is a file named for a
+ * 128-bit hash of the version key, the command, and its input, written to a
+ * temporary file and renamed into place so that readers never see half of
+ * one. The hash isn't cryptographic, so it only finds an entry; the entry
+ * holds the command and input it was made for, and both are checked in full,
+ * so that a crafted collision can't pass one entry off as another. The cache
+ * directory is created private to its owner. Entries expire after a fixed
+ * age, and the oldest are evicted when the cache grows past a fixed size.
+ *
+ * Hits, misses, and the like are counted in memory and added to a statistics
+ * file in the cache directory, under a lock, when the Cache is destroyed; the
+ * size limit is enforced at the same time.
+ */
+class Cache {
+public:
+
+	/**
+	 * What an entry is filed under. The hash names the file; the identity,
+	 * which is everything but the input, and the input itself are stored in
+	 * the file and checked on every hit.
+	 */
+	struct Key {
+
+		uint64_t hash[2];
+		std::string identity;
+		std::string input;
+
+		std::string filename() const;
+
+	};
+
+	Cache(const std::string&, const std::string&, std::time_t, uint64_t);
+	~Cache();
+
+	Key key(const std::vector<std::string>&, const std::string&) const;
+	bool find(const Key&, std::string&);
+	void store(const Key&, const std::string&);
+
+private:
+
+	Cache(const Cache&) = delete;
+	Cache& operator=(const Cache&) = delete;
+
+	bool load(const Key&, std::string&) const;
+	void flush();
+	uint64_t evict(uint64_t&) const;
+
+	std::string directory;
+	std::string version;
+	std::time_t lifetime;
+	uint64_t capacity;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t bytes;
+
+};
+
+
+#endif
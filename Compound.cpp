@@ -1,19 +1,34 @@
 #include "Compound.h"
 #include "Block.h"
+#include "Builder.h"
+#include "Cache.h"
 #include "Content.h"
 #include "Context.h"
 #include "Data.h"
+#include "Dictionary.h"
+#include "Escape.h"
 #include "Identifier.h"
+#include "Image.h"
 #include "Interpreter.h"
+#include "Json.h"
 #include "List.h"
+#include "Mapping.h"
 #include "Parser.h"
+#include "Pending.h"
+#include "Process.h"
+#include "Regex.h"
 #include "Scanner.h"
+#include "Scheduler.h"
+#include "Sort.h"
+#include "Text.h"
+#include "Vector.h"
+#include <algorithm>
 #include <cmath>
-#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <unordered_set>
 
 
 /**
@@ -24,14 +39,53 @@
  */
 decltype(Compound::evaluators) Compound::evaluators {
 
+	std::make_pair("append",    &Compound::evaluate_append),
+	std::make_pair("builder",   &Compound::evaluate_builder),
+	std::make_pair("concat",    &Compound::evaluate_concat),
+	std::make_pair("count",     &Compound::evaluate_reduce),
 	std::make_pair("def",       &Compound::evaluate_def),
+	std::make_pair("dict",      &Compound::evaluate_dict),
 	std::make_pair("error",     &Compound::evaluate_error),
+	std::make_pair("escape_html",  &Compound::evaluate_text),
+	std::make_pair("escape_json",  &Compound::evaluate_text),
+	std::make_pair("escape_shell", &Compound::evaluate_text),
+	std::make_pair("escape_url",   &Compound::evaluate_text),
 	std::make_pair("extern",    &Compound::evaluate_extern),
 	std::make_pair("file",      &Compound::evaluate_file),
+	std::make_pair("finish",    &Compound::evaluate_finish),
+	std::make_pair("for",       &Compound::evaluate_for),
+	std::make_pair("get",       &Compound::evaluate_get),
+	std::make_pair("has",       &Compound::evaluate_has),
 	std::make_pair("header",    &Compound::evaluate_header),
 	std::make_pair("if",        &Compound::evaluate_if),
+	std::make_pair("join",      &Compound::evaluate_join),
+	std::make_pair("json",      &Compound::evaluate_json),
+	std::make_pair("keys",      &Compound::evaluate_keys),
+	std::make_pair("length",    &Compound::evaluate_length),
+	std::make_pair("load",      &Compound::evaluate_load),
 	std::make_pair("local",     &Compound::evaluate_local),
+	std::make_pair("lower",     &Compound::evaluate_text),
+	std::make_pair("map",       &Compound::evaluate_for),
+	std::make_pair("match",     &Compound::evaluate_match),
+	std::make_pair("max",       &Compound::evaluate_reduce),
+	std::make_pair("mean",      &Compound::evaluate_reduce),
+	std::make_pair("min",       &Compound::evaluate_reduce),
 	std::make_pair("namespace", &Compound::evaluate_namespace),
+	std::make_pair("nth",       &Compound::evaluate_nth),
+	std::make_pair("range",     &Compound::evaluate_range),
+	std::make_pair("replace",   &Compound::evaluate_replace),
+	std::make_pair("reverse",   &Compound::evaluate_reverse),
+	std::make_pair("search",    &Compound::evaluate_search),
+	std::make_pair("slice",     &Compound::evaluate_slice),
+	std::make_pair("sort",      &Compound::evaluate_sort),
+	std::make_pair("sort_by_data", &Compound::evaluate_sort),
+	std::make_pair("split",     &Compound::evaluate_split),
+	std::make_pair("substitute", &Compound::evaluate_substitute),
+	std::make_pair("substring", &Compound::evaluate_substring),
+	std::make_pair("sum",       &Compound::evaluate_reduce),
+	std::make_pair("trim",      &Compound::evaluate_text),
+	std::make_pair("unique",    &Compound::evaluate_unique),
+	std::make_pair("upper",     &Compound::evaluate_text),
 	std::make_pair("use",       &Compound::evaluate_use),
 	std::make_pair("using",     &Compound::evaluate_using),
 	std::make_pair("warn",      &Compound::evaluate_warn),
@@ -124,6 +178,39 @@ decltype(Compound::math_functions) Compound::math_functions {
 };
 
 
+/**
+ * Math builtins applied to whole Lists go element by element. The ones that
+ * are common enough to be worth it have kernels that do many elements at a
+ * time; the rest fall back to the functions above, one element at a time.
+ */
+decltype(Compound::math_kernels) Compound::math_kernels {
+	std::make_pair("+",  vector_add),
+	std::make_pair("-",  vector_subtract),
+	std::make_pair("*",  vector_multiply),
+	std::make_pair("/",  vector_divide),
+	std::make_pair("<",  vector_less),
+	std::make_pair(">=", vector_not_less),
+	std::make_pair("=",  vector_equal),
+	std::make_pair("<>", vector_not_equal),
+	std::make_pair(">",  vector_greater),
+	std::make_pair("<=", vector_not_greater),
+};
+
+
+/**
+ * Likewise the string builtins that take some text and give back some text.
+ */
+decltype(Compound::text_functions) Compound::text_functions {
+	std::make_pair("escape_html",  escape_html),
+	std::make_pair("escape_json",  escape_json),
+	std::make_pair("escape_shell", escape_shell),
+	std::make_pair("escape_url",   escape_url),
+	std::make_pair("lower",        text_lower),
+	std::make_pair("trim",         text_trim),
+	std::make_pair("upper",        text_upper),
+};
+
+
 // Obvious bits.
 
 
@@ -133,54 +220,116 @@ Compound::Compound(int line, int column) : Expression(line, column) {}
 Compound::~Compound() {}
 
 
-void Compound::set_determiner(std::shared_ptr<const Expression> expression) {
+void Compound::set_determiner(Reference<const Expression> expression) {
 	determiner = expression;
 }
 
 
-void Compound::set_identifier(const std::string& string) {
-	identifier = string;
+void Compound::set_identifier(Symbol symbol) {
+	identifier = symbol;
 }
 
 
 void Compound::add_data() {
-	data.push_back(std::vector<std::shared_ptr<const Expression>>());
+	data.push_back(std::vector<Reference<const Expression>>());
 }
 
 
-void Compound::add_data(std::shared_ptr<const Expression> expression) {
+void Compound::add_data(Reference<const Expression> expression) {
 	if (data.empty()) add_data();
 	data.back().push_back(expression);
 }
 
 
 void Compound::add_content() {
-	content.push_back(std::vector<std::shared_ptr<const Expression>>());
+	content.push_back(std::vector<Reference<const Expression>>());
 }
 
 
-void Compound::add_content(std::shared_ptr<const Expression> expression) {
+void Compound::add_content(Reference<const Expression> expression) {
 	if (content.empty()) add_content();
 	content.back().push_back(expression);
 }
 
 
-bool Compound::is_keyword(const std::string& name) {
+bool Compound::is_keyword(Symbol name) {
 	return evaluators.find(name) != evaluators.end();
 }
 
 
+/**
+ * Give a Value a name, if the expression has one, and yield nothing; or else
+ * just yield the Value. This is how keywords that make Dictionaries share
+ * them with the rest of the program.
+ */
+Reference<const List> Compound::name_value(Context& context,
+	Reference<const Value> value) const {
+
+	Reference<List> result(new List(line_number, column_number));
+
+	if (identifier.empty()) {
+		result->add(value);
+		return static_reference_cast<const List>(result);
+	}
+
+	if (is_keyword(identifier)) {
+		std::ostringstream message;
+		message << "Attempt to define template with reserved name \""
+			<< identifier << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	context.define(Signature(identifier),
+		static_reference_cast<const Expression>(value));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * The builder named by the identifier, which had better be one.
+ */
+Reference<const Builder> Compound::find_builder(Context& context) const {
+	if (identifier.empty())
+		throw std::runtime_error("Expected the name of a builder.");
+	const Reference<const List> list = context.evaluate(identifier);
+	Reference<const Builder> result;
+	if (list->size() == 1)
+		result = dynamic_reference_cast<const Builder>(list->at(0));
+	if (!result) {
+		std::ostringstream message;
+		message << "\"" << identifier << "\" is not a builder.";
+		throw std::runtime_error(message.str());
+	}
+	return result;
+}
+
+
+/**
+ * The Dictionary that a list should consist of.
+ */
+static Reference<const Dictionary> expect_dictionary
+	(const Reference<const List>& list) {
+	Reference<const Dictionary> result;
+	if (list->size() == 1)
+		result = dynamic_reference_cast<const Dictionary>(list->at(0));
+	if (!result)
+		throw std::runtime_error("Expected a dictionary.");
+	return result;
+}
+
+
 /**
  * To evaluate a Compound Expression, just look up what sort of Expression it
  * is, and bang, you're done. There are some crufty bits to account for
  * parameter passing and errors, of course.
  */
-std::shared_ptr<const List> Compound::evaluate(Context& context) const {
+Reference<const List> Compound::evaluate(Context& context) const {
 
-	std::string id;
+	Symbol id;
 
-	if (std::dynamic_pointer_cast<const Identifier>(determiner))
-		id = std::static_pointer_cast<const Identifier>(determiner)->value;
+	if (dynamic_reference_cast<const Identifier>(determiner))
+		id = static_reference_cast<const Identifier>(determiner)->value;
 	else
 		id = determiner->evaluate(context)->get_content();
 
@@ -189,7 +338,7 @@ std::shared_ptr<const List> Compound::evaluate(Context& context) const {
 		auto evaluator = evaluators.find(id);
 
 		if (evaluator != evaluators.end())
-			return (this->*evaluator->second)(id, context);
+			return (this->*evaluator->second)(id.string(), context);
 
 		std::vector<std::vector<double>> data_parameters;
 		std::vector<std::vector<std::string>> content_parameters;
@@ -227,10 +376,64 @@ std::shared_ptr<const List> Compound::evaluate(Context& context) const {
 }
 
 
+/**
+ * Add the content of each section to the end of a builder.
+ */
+Reference<const List> Compound::evaluate_append
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.empty())
+		throw std::runtime_error("Invalid use of \"append\".");
+
+	const Reference<const Builder> builder = find_builder(context);
+	for (auto i = content.begin(); i != content.end(); ++i)
+		builder->append(*Block(line_number, column_number,
+			*i).evaluate(context));
+
+	return Reference<const List>(new List(line_number, column_number));
+
+}
+
+
+/**
+ * Define an empty builder in the current scope, to be added to with append and
+ * turned into content with finish:
+ *
+ *     builder[row] append[row]{"a"}{","} append[row]{"b"} finish[row]
+ */
+Reference<const List> Compound::evaluate_builder
+	(const std::string& id, Context& context) const {
+
+	if (identifier.empty() || data.size() != 0 || content.size() != 0)
+		throw std::runtime_error("Invalid use of \"builder\".");
+
+	return name_value(context, Reference<const Value>(new Builder
+		(line_number, column_number)));
+
+}
+
+
+/**
+ * Join some lists end to end. Long lists are shared rather than copied.
+ */
+Reference<const List> Compound::evaluate_concat
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.empty())
+		throw std::runtime_error("Invalid use of \"concat\".");
+
+	Reference<List> result(new List(line_number, column_number));
+	for (auto i = content.begin(); i != content.end(); ++i)
+		result->add(Block(line_number, column_number, *i).evaluate(context));
+	return static_reference_cast<const List>(result);
+
+}
+
+
 /**
  * Evaluate a "def" expression, defining a new template in the current Context.
  */
-std::shared_ptr<const List> Compound::evaluate_def(const std::string& id,
+Reference<const List> Compound::evaluate_def(const std::string& id,
 	Context& context) const {
 
 	if (is_keyword(identifier)) {
@@ -240,21 +443,21 @@ std::shared_ptr<const List> Compound::evaluate_def(const std::string& id,
 		throw std::runtime_error(message.str());
 	}
 
-	std::vector<std::vector<std::string>> data_parameters;
-	std::vector<std::vector<std::string>> content_parameters;
+	std::vector<std::vector<Symbol>> data_parameters;
+	std::vector<std::vector<Symbol>> content_parameters;
 
 	// All things must have a name...
 	for (auto i = data.begin(); i != data.end(); ++i) {
-		data_parameters.push_back(std::vector<std::string>());
+		data_parameters.push_back(std::vector<Symbol>());
 		for (auto j = i->begin(); j != i->end(); ++j) {
-			if (!std::dynamic_pointer_cast<const Identifier>(*j)) {
+			if (!dynamic_reference_cast<const Identifier>(*j)) {
 				std::ostringstream message;
 				message << "Attempt to define template \""
 					<< identifier << "\" with invalid data signature.";
 				throw std::runtime_error(message.str());
 			}
 			data_parameters.back().push_back
-				(std::static_pointer_cast<const Identifier>(*j)->value);
+				(static_reference_cast<const Identifier>(*j)->value);
 		}
 	}
 
@@ -263,25 +466,57 @@ std::shared_ptr<const List> Compound::evaluate_def(const std::string& id,
 		auto content_pre_end = content.begin();
 		std::advance(content_pre_end, content.size() - 1);
 		for (auto i = content.begin(); i != content_pre_end; ++i) {
-			content_parameters.push_back(std::vector<std::string>());
+			content_parameters.push_back(std::vector<Symbol>());
 			for (auto j = i->begin(); j != i->end(); ++j) {
-				if (!std::dynamic_pointer_cast<const Identifier>(*j)) {
+				if (!dynamic_reference_cast<const Identifier>(*j)) {
 					std::ostringstream message;
 					message << "Attempt to define template \""
 						<< identifier << "\" with invalid content signature.";
 					throw std::runtime_error(message.str());
 				}
 				content_parameters.back().push_back
-					(std::static_pointer_cast<const Identifier>(*j)->value);
+					(static_reference_cast<const Identifier>(*j)->value);
 			}
 		}
 	}
 
 	Signature signature(identifier, data_parameters, content_parameters);
-	context.define(signature, std::shared_ptr<const Expression>
+	context.define(signature, Reference<const Expression>
 		(new Block(line_number, column_number, content.back())));
 
-	return std::shared_ptr<const List>(new List(line_number, column_number));
+	return Reference<const List>(new List(line_number, column_number));
+
+}
+
+
+/**
+ * Make a Dictionary from alternating keys and values:
+ *
+ *     dict[codes]{"fr" "France" "de" "Germany"}
+ *
+ * With a name, the Dictionary is defined as a template of that name, which
+ * is the usual way to keep it around; without one, it is simply the result.
+ */
+Reference<const List> Compound::evaluate_dict
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() > 1)
+		throw std::runtime_error("Invalid use of \"dict\".");
+
+	Reference<Dictionary> dictionary(new Dictionary(line_number,
+		column_number));
+
+	if (!content.empty()) {
+		const Reference<const List> items = Block(line_number, column_number,
+			content[0]).evaluate(context);
+		if (items->size() % 2 != 0)
+			throw std::runtime_error("Dictionary has a key with no value.");
+		for (std::size_t i = 0; i < items->size(); i += 2)
+			dictionary->set(items->at(i)->get_content(), items->at(i + 1));
+	}
+
+	return name_value(context, static_reference_cast<const Value>
+		(dictionary));
 
 }
 
@@ -289,7 +524,7 @@ std::shared_ptr<const List> Compound::evaluate_def(const std::string& id,
 /**
  * Die with a user-defined error message.
  */
-std::shared_ptr<const List> Compound::evaluate_error
+Reference<const List> Compound::evaluate_error
 	(const std::string& id, Context& context) const {
 
 	if (data.size() != 0 || content.size() != 1)
@@ -306,7 +541,7 @@ std::shared_ptr<const List> Compound::evaluate_error
 /**
  * Do some really filthy stuff with a strange program.
  */
-std::shared_ptr<const List> Compound::evaluate_extern
+Reference<const List> Compound::evaluate_extern
 	(const std::string& id, Context& context) const {
 
 	const bool closed_form = !identifier.empty();
@@ -317,42 +552,52 @@ std::shared_ptr<const List> Compound::evaluate_extern
 		content.size() > 2)
 		throw std::runtime_error("Invalid use of \"extern\".");
 
-	std::string command = closed_form ? identifier :  Block(line_number,
+	std::string command = closed_form ? identifier.string() : Block(line_number,
 		column_number, content[0]).evaluate(context)->get_content();
 
 	std::string input = has_input ? Block(line_number, column_number,
 		closed_form ? content[0] : content[1]).evaluate
 		(context)->get_content() : "";
 
-	// By the way, it's very important that you don't perform any evaluation
-	// while you're writing to the (admittedly awkward, but hey) temporary file.
-	// If you can't see why, consider "extern[x]{y extern[x]{z}}".
-	// Single-threaded applications for the win.
-	if (has_input) {
-
-		command += " < .vision.temp";
-		std::ofstream file(".vision.temp");
-		if (!file.is_open())
-			return std::shared_ptr<const List>
-				(new List(line_number, column_number));
-		file << input;
-		file.close();
-
+	const std::vector<std::string> arguments = context.direct_mode ?
+		Process::split(command) : Process::shell(command);
+	Reference<List> result(new List(line_number, column_number));
+
+	// A cached result doesn't need a process at all. Only the output of
+	// commands that succeed is worth remembering.
+	std::shared_ptr<Cache> cache = context.cache;
+	Cache::Key key;
+	Scheduler::Callback remember;
+	if (cache) {
+		std::string output;
+		key = cache->key(arguments, input);
+		if (cache->find(key, output)) {
+			result->add(Reference<const Value>(new Content
+				(line_number, column_number, output)));
+			return static_reference_cast<const List>(result);
+		}
+		remember = [cache, key](const std::string& output) {
+			cache->store(key, output);
+		};
 	}
 
-	std::ostringstream output;
-	FILE* pipe = popen(command.c_str(), "r");
-	int c;
-	while ((c = std::getc(pipe)) != EOF) output.put(c);
-	pclose(pipe);
-
-	if (has_input)
-		std::remove(".vision.temp");
+	// With a Scheduler, the command runs in the background and evaluation
+	// carries on; its output is spliced in wherever it ends up once someone
+	// asks for it, which for the page itself is in source order at the end.
+	if (context.scheduler) {
+		result->add(Reference<const Value>(new Pending(line_number,
+			column_number, context.scheduler,
+			context.scheduler->start(arguments, input, remember))));
+		return static_reference_cast<const List>(result);
+	}
 
-	std::shared_ptr<List> result(new List(line_number, column_number));
-	result->add(std::shared_ptr<const Value>(new Content
-		(line_number, column_number, output.str())));
-	return std::static_pointer_cast<const List>(result);
+	Process process(arguments, input);
+	process.wait();
+	if (remember && process.succeeded())
+		remember(process.get_output());
+	result->add(Reference<const Value>(new Content
+		(line_number, column_number, process.get_output())));
+	return static_reference_cast<const List>(result);
 
 }
 
@@ -360,28 +605,144 @@ std::shared_ptr<const List> Compound::evaluate_extern
 /**
  * Expand the contents of a file as content.
  */
-std::shared_ptr<const List> Compound::evaluate_file
+Reference<const List> Compound::evaluate_file
 	(const std::string& id, Context& context) const {
 
 	if (data.size() != 0 || content.size() != 1)
 		throw std::runtime_error("Invalid use of \"file\".");
 
-	std::string contents;
-	std::ifstream file(Block(line_number, column_number,
-		content[0]).evaluate(context)->get_content().c_str());
+	const std::string path = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	std::shared_ptr<const Mapping> file = context.map(path);
 
-	if (!file.is_open())
-		return std::shared_ptr<const List>
+	if (!file)
+		return Reference<const List>
 			(new List(line_number, column_number));
 
-	std::copy(std::istreambuf_iterator<char>(file),
-		std::istreambuf_iterator<char>(),
-		std::back_inserter(contents));
+	context.sources.insert(path);
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content
+		(line_number, column_number, file)));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Take everything a builder has built as content, leaving it empty.
+ */
+Reference<const List> Compound::evaluate_finish
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 0)
+		throw std::runtime_error("Invalid use of \"finish\".");
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content(line_number,
+		column_number, find_builder(context)->finish())));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Evaluate some content once for each element of a list, with the element
+ * bound to a name, and yield all of the results together. The list is either
+ * a data section or a content section:
+ *
+ *     for[x](1 2 3){...}
+ *     for[x]{split{"a b c"}{" "}}{...}
+ *
+ * "map" is the same, but yields exactly one element for each element of the
+ * list, so that the result lines up with the input; a body that yields
+ * anything other than a single value is joined into a single Content.
+ *
+ * All iterations share one scope, and the results go straight into one List,
+ * so a loop is linear in the number of elements, unlike a recursive template.
+ */
+Reference<const List> Compound::evaluate_for
+	(const std::string& id, Context& context) const {
+
+	const bool data_form = data.size() == 1 && content.size() == 1;
+	if (identifier.empty() || !(data_form ||
+		(data.empty() && content.size() == 2))) {
+		std::ostringstream message;
+		message << "Invalid use of \"" << id << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	const Reference<const List> items = Block(line_number, column_number,
+		data_form ? data[0] : content[0]).evaluate(context);
+	const Block body(line_number, column_number, content.back());
+	const bool mapping = id == "map";
+
+	Reference<List> result(new List(line_number, column_number));
+	result->reserve(items->size());
+
+	context.enter_scope();
+	for (std::size_t i = 0; i < items->size(); ++i) {
+		context.rebind(identifier, static_reference_cast<const Expression>
+			(items->at(i)));
+		const Reference<const List> value = body.evaluate(context);
+		if (mapping && value->size() != 1)
+			result->add(Reference<const Value>(new Content
+				(line_number, column_number, value->get_content())));
+		else
+			result->add(value);
+	}
+	context.exit_scope();
 
-	std::shared_ptr<List> result(new List(line_number, column_number));
-	result->add(std::shared_ptr<const Value>(new Content
-		(line_number, column_number, contents)));
-	return std::static_pointer_cast<const List>(result);
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Look up a key in a Dictionary, yielding nothing, or the given default, if
+ * it's not there:
+ *
+ *     get{codes}{"fr"}
+ *     get{codes}{country}{"Unknown"}
+ */
+Reference<const List> Compound::evaluate_get
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() < 2 || content.size() > 3)
+		throw std::runtime_error("Invalid use of \"get\".");
+
+	const Reference<const Dictionary> dictionary = expect_dictionary
+		(Block(line_number, column_number, content[0]).evaluate(context));
+	const Reference<const Value> value = dictionary->get(Block(line_number,
+		column_number, content[1]).evaluate(context)->get_content());
+
+	if (!value && content.size() == 3)
+		return Block(line_number, column_number, content[2]).evaluate(context);
+
+	Reference<List> result(new List(line_number, column_number));
+	if (value) result->add(value);
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Test whether a Dictionary has a key.
+ */
+Reference<const List> Compound::evaluate_has
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 2)
+		throw std::runtime_error("Invalid use of \"has\".");
+
+	const Reference<const Dictionary> dictionary = expect_dictionary
+		(Block(line_number, column_number, content[0]).evaluate(context));
+	const bool found = bool(dictionary->get(Block(line_number,
+		column_number, content[1]).evaluate(context)->get_content()));
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Data
+		(line_number, column_number, found)));
+	return static_reference_cast<const List>(result);
 
 }
 
@@ -389,7 +750,7 @@ std::shared_ptr<const List> Compound::evaluate_file
 /**
  * Send some content to the header buffer.
  */
-std::shared_ptr<const List> Compound::evaluate_header
+Reference<const List> Compound::evaluate_header
 	(const std::string& id, Context& context) const {
 
 	if (data.size() != 0)
@@ -401,7 +762,7 @@ std::shared_ptr<const List> Compound::evaluate_header
 		context.head_buffer << '\n';
 	}
 
-	return std::shared_ptr<const List>(new List(line_number, column_number));
+	return Reference<const List>(new List(line_number, column_number));
 
 }
 
@@ -409,7 +770,7 @@ std::shared_ptr<const List> Compound::evaluate_header
 /**
  * Conditionally evaluate some Expressions.
  */
-std::shared_ptr<const List> Compound::evaluate_if
+Reference<const List> Compound::evaluate_if
 	(const std::string& id, Context& context) const {
 
 	if (data.size() != 1 || content.size() != 1)
@@ -421,7 +782,133 @@ std::shared_ptr<const List> Compound::evaluate_if
 	if (condition != 0.0)
 		return Block(line_number, column_number, content[0]).evaluate(context);
 
-	return std::shared_ptr<const List>(new List(line_number, column_number));
+	return Reference<const List>(new List(line_number, column_number));
+
+}
+
+
+/**
+ * Join a list of content with a separator.
+ */
+Reference<const List> Compound::evaluate_join
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 2)
+		throw std::runtime_error("Invalid use of \"join\".");
+
+	const std::string separator = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::vector<std::string> items = Block(line_number, column_number,
+		content[1]).evaluate(context)->flat_content();
+
+	std::string joined;
+	for (auto i = items.begin(); i != items.end(); ++i) {
+		if (i != items.begin()) joined += separator;
+		joined += *i;
+	}
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content
+		(line_number, column_number, joined)));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Decode some JSON, yielding it or, given a name, defining it.
+ */
+Reference<const List> Compound::evaluate_json
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"json\".");
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	return name_value(context, Json(text).value(line_number,
+		column_number));
+
+}
+
+
+/**
+ * List the keys of a Dictionary, in the order they were first set.
+ */
+Reference<const List> Compound::evaluate_keys
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"keys\".");
+
+	const Reference<const Dictionary> dictionary = expect_dictionary
+		(Block(line_number, column_number, content[0]).evaluate(context));
+	const std::vector<Symbol>& keys = dictionary->keys();
+
+	Reference<List> result(new List(line_number, column_number));
+	result->reserve(keys.size());
+	for (auto i = keys.begin(); i != keys.end(); ++i)
+		result->add(Reference<const Value>(new Content
+			(line_number, column_number, i->string())));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Count the characters in some content, or the elements of a list given as a
+ * data section:
+ *
+ *     length{"héllo"}             5
+ *     length(split{"a b"}{" "})    2
+ */
+Reference<const List> Compound::evaluate_length
+	(const std::string& id, Context& context) const {
+
+	double value;
+	if (data.size() == 1 && content.empty())
+		value = Block(line_number, column_number,
+			data[0]).evaluate(context)->size();
+	else if (data.empty() && content.size() == 1)
+		value = text_length(Block(line_number, column_number,
+			content[0]).evaluate(context)->get_content());
+	else
+		throw std::runtime_error("Invalid use of \"length\".");
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Data
+		(line_number, column_number, value)));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Load a Dictionary from a file of tab-separated keys and values, one pair to
+ * a line, as with "dict":
+ *
+ *     load[prices]{"prices.tsv"}
+ */
+Reference<const List> Compound::evaluate_load
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"load\".");
+
+	const std::string path = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::shared_ptr<const Mapping> file = context.map(path);
+
+	if (!file) {
+		std::ostringstream message;
+		message << "Unable to load dictionary \"" << path << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	context.sources.insert(path);
+	return name_value(context, static_reference_cast<const Value>
+		(Dictionary::parse(line_number, column_number, file->data(),
+		file->size())));
 
 }
 
@@ -429,7 +916,7 @@ std::shared_ptr<const List> Compound::evaluate_if
 /**
  * Evaluate in a new local scope.
  */
-std::shared_ptr<const List> Compound::evaluate_local
+Reference<const List> Compound::evaluate_local
 	(const std::string& id, Context& context) const {
 
 	if (content.size() != 1)
@@ -445,9 +932,39 @@ std::shared_ptr<const List> Compound::evaluate_local
 
 
 /**
- * Evaluate a math expression.
+ * Test whether the whole of some content matches a regular expression.
+ */
+Reference<const List> Compound::evaluate_match
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 2)
+		throw std::runtime_error("Invalid use of \"match\".");
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::shared_ptr<const Regex> regex = Regex::compile(Block
+		(line_number, column_number, content[1]).evaluate(context)
+		->get_content());
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Data
+		(line_number, column_number, regex->match(text))));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Evaluate a math expression. Operands are usually single numbers, but any of
+ * them may be a List, in which case the operation is applied element by
+ * element, with single numbers repeated to match:
+ *
+ *     +(1 2 3)(10)        11 12 13
+ *     *(1 2 3)(4 5 6)     4 10 18
+ *
+ * Lists used together must be the same length.
  */
-std::shared_ptr<const List> Compound::evaluate_math
+Reference<const List> Compound::evaluate_math
 	(const std::string& id, Context& context) const {
 
 	const int arity = math_arities.find(id)->second;
@@ -458,20 +975,63 @@ std::shared_ptr<const List> Compound::evaluate_math
 		throw std::runtime_error(message.str());
 	}
 
-	std::vector<double> operands;
+	std::vector<std::vector<double>> operands;
+	std::size_t size = 1;
 
-	for (auto i = data.begin(); i != data.end(); ++i)
+	for (auto i = data.begin(); i != data.end(); ++i) {
 		operands.push_back(Block(line_number, column_number, *i).evaluate
-			(context)->get_data());
+			(context)->flat_data());
+		const std::size_t length = operands.back().size();
+		if (length == 0)
+			operands.back().push_back(0);
+		if (length <= 1)
+			continue;
+		if (size != 1 && size != length) {
+			std::ostringstream message;
+			message << "Mismatched list lengths " << size << " and "
+				<< length << ".";
+			throw std::runtime_error(message.str());
+		}
+		size = length;
+	}
 
 	const auto function = math_functions.find(id)->second;
-	const double value = function(operands);
+	Reference<List> result(new List(line_number, column_number));
+
+	if (size == 1) {
+		std::vector<double> values;
+		for (auto i = operands.begin(); i != operands.end(); ++i)
+			values.push_back(i->front());
+		result->add(Reference<const Value>(new Data
+			(line_number, column_number, function(values))));
+		return static_reference_cast<const List>(result);
+	}
 
-	std::shared_ptr<List> result(new List(line_number, column_number));
-	result->add(std::shared_ptr<const Value>(new Data
-		(line_number, column_number, value)));
+	for (auto i = operands.begin(); i != operands.end(); ++i)
+		if (i->size() == 1)
+			i->assign(size, i->front());
+
+	std::vector<double> values(size);
+	const auto kernel = math_kernels.find(id);
+
+	if (kernel != math_kernels.end()) {
+		kernel->second(operands[0].data(), operands[1].data(), values.data(),
+			size);
+	} else {
+		std::vector<double> element(arity);
+		for (std::size_t i = 0; i < size; ++i) {
+			for (int j = 0; j < arity; ++j)
+				element[j] = operands[j][i];
+			values[i] = function(element);
+		}
+	}
+
+	result->reserve(size);
+	for (auto i = values.begin(); i != values.end(); ++i)
+		result->add(Reference<const Value>(new Data
+			(line_number, column_number, *i)));
 
-	return std::static_pointer_cast<const List>(result);
+	return static_reference_cast<const List>(result);
 
 }
 
@@ -556,7 +1116,7 @@ double math_not_greater(const std::vector<double>& operands) {
 /**
  * Evaluate in a named local scope.
  */
-std::shared_ptr<const List> Compound::evaluate_namespace
+Reference<const List> Compound::evaluate_namespace
 	(const std::string& id, Context& context) const {
 
 	context.enter_scope(identifier);
@@ -568,10 +1128,415 @@ std::shared_ptr<const List> Compound::evaluate_namespace
 }
 
 
+/**
+ * Get one element of a list by position, counting from zero, or from the end
+ * if negative.
+ */
+Reference<const List> Compound::evaluate_nth
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 1 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"nth\".");
+
+	const double index = Block(line_number, column_number,
+		data[0]).evaluate(context)->get_data();
+	const Reference<const List> items = Block(line_number, column_number,
+		content[0]).evaluate(context);
+	const double position = index < 0 ? index + items->size() : index;
+
+	if (!std::isfinite(position) || position < 0
+		|| position >= items->size()) {
+		std::ostringstream message;
+		message << "Index " << index << " out of range for list of "
+			<< items->size() << " elements.";
+		throw std::runtime_error(message.str());
+	}
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(items->at(std::size_t(position)));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Count from start to end, inclusive, by step:
+ *
+ *     range(5)            1 2 3 4 5
+ *     range(0)(10)(5)     0 5 10
+ *     range(3)(1)         3 2 1
+ *
+ * The step is 1, or -1 if counting down, unless given. The numbers are made
+ * up as they're used, so a range costs nothing like a List of its numbers.
+ */
+Reference<const List> Compound::evaluate_range
+	(const std::string& id, Context& context) const {
+
+	if (data.empty() || data.size() > 3 || !content.empty())
+		throw std::runtime_error("Invalid use of \"range\".");
+
+	std::vector<double> bounds;
+	for (auto i = data.begin(); i != data.end(); ++i)
+		bounds.push_back(Block(line_number, column_number,
+			*i).evaluate(context)->get_data());
+
+	const double start = bounds.size() == 1 ? 1 : bounds[0];
+	const double end = bounds.size() == 1 ? bounds[0] : bounds[1];
+	const double step = bounds.size() == 3 ? bounds[2] : end < start ? -1 : 1;
+
+	if (step == 0 || !std::isfinite(start) || !std::isfinite(end)
+		|| !std::isfinite(step))
+		throw std::runtime_error("Invalid range.");
+
+	// A little slack, so that steps like 0.1 that aren't quite what they
+	// seem don't lose the last number. Past 2^53 steps, positions in the
+	// range can't all be told apart as doubles anyway.
+	const double steps = std::floor((end - start) / step + 1e-9);
+	if (steps >= 9007199254740992.0)
+		throw std::runtime_error("Invalid range.");
+	const std::size_t size = steps < 0 ? 0 : std::size_t(steps) + 1;
+
+	return List::range(line_number, column_number, start, step, size);
+
+}
+
+
+/**
+ * Reduce a list of data to a single number: its "sum", "min", "max", "mean",
+ * or "count". The smallest and largest of nothing, and the mean of nothing,
+ * are errors. The list is reduced as it is, without being flattened, so that
+ * even a very long range costs next to nothing.
+ */
+Reference<const List> Compound::evaluate_reduce
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 1 || !content.empty()) {
+		std::ostringstream message;
+		message << "Invalid use of \"" << id << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	const Reference<const List> values = Block(line_number, column_number,
+		data[0]).evaluate(context);
+	double value;
+
+	if (id == "count") {
+		value = values->size();
+	} else if (id == "sum") {
+		value = values->sum();
+	} else if (values->size() == 0) {
+		std::ostringstream message;
+		message << "Attempt to take \"" << id << "\" of empty list.";
+		throw std::runtime_error(message.str());
+	} else if (id == "min") {
+		value = values->minimum();
+	} else if (id == "max") {
+		value = values->maximum();
+	} else {
+		value = values->sum() / values->size();
+	}
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Data
+		(line_number, column_number, value)));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Replace every occurrence of some content with some other content.
+ */
+Reference<const List> Compound::evaluate_replace
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 3)
+		throw std::runtime_error("Invalid use of \"replace\".");
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::string from = Block(line_number, column_number,
+		content[1]).evaluate(context)->get_content();
+	const std::string to = Block(line_number, column_number,
+		content[2]).evaluate(context)->get_content();
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content
+		(line_number, column_number, text_replace(text, from, to))));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Reverse a list.
+ */
+Reference<const List> Compound::evaluate_reverse
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"reverse\".");
+
+	return Block(line_number, column_number,
+		content[0]).evaluate(context)->reverse();
+
+}
+
+
+/**
+ * Find the first match of a regular expression in some content, yielding the
+ * match followed by each of its groups, or nothing if there's no match.
+ */
+Reference<const List> Compound::evaluate_search
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 2)
+		throw std::runtime_error("Invalid use of \"search\".");
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::shared_ptr<const Regex> regex = Regex::compile(Block
+		(line_number, column_number, content[1]).evaluate(context)
+		->get_content());
+
+	Reference<List> result(new List(line_number, column_number));
+	std::vector<std::size_t> groups;
+	if (!regex->search(text, 0, groups))
+		return static_reference_cast<const List>(result);
+
+	result->reserve(groups.size() / 2);
+	for (std::size_t i = 0; i < groups.size(); i += 2)
+		result->add(Reference<const Value>(new Content
+			(line_number, column_number, groups[i] == std::string::npos
+			? std::string() : text.substr(groups[i], groups[i + 1]
+			- groups[i]))));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Take part of a list, by position, as for "substring".
+ */
+Reference<const List> Compound::evaluate_slice
+	(const std::string& id, Context& context) const {
+
+	if (data.size() < 1 || data.size() > 2 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"slice\".");
+
+	double start = Block(line_number, column_number,
+		data[0]).evaluate(context)->get_data();
+	double count = data.size() == 2 ? Block(line_number, column_number,
+		data[1]).evaluate(context)->get_data() : -1;
+	const Reference<const List> items = Block(line_number, column_number,
+		content[0]).evaluate(context);
+
+	if (!std::isfinite(start) || !std::isfinite(count))
+		throw std::runtime_error("Invalid slice position.");
+
+	const double size = items->size();
+	if (start < 0) start += size;
+	start = std::max(0.0, std::min(start, size));
+	count = count < 0 ? size : std::min(count, size);
+	return items->slice(std::size_t(start), std::size_t(count));
+
+}
+
+
+/**
+ * Sort a list, stably, by content or, for "sort_by_data", by data. The list
+ * is either a data section or a content section, as with "for"; and with a
+ * name, each element is bound to it in turn to compute the key that it's
+ * sorted by:
+ *
+ *     sort{split{"b a c"}{" "}}
+ *     sort_by_data(3 1 2)
+ *     sort_by_data[row]{rows}{get{row}{"score"}}
+ */
+Reference<const List> Compound::evaluate_sort
+	(const std::string& id, Context& context) const {
+
+	const std::size_t sections = identifier.empty() ? 1 : 2;
+	if (data.size() > 1 || data.size() + content.size() != sections) {
+		std::ostringstream message;
+		message << "Invalid use of \"" << id << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	const Reference<const List> items = Block(line_number, column_number,
+		data.empty() ? content[0] : data[0]).evaluate(context);
+	const bool by_data = id == "sort_by_data";
+	std::vector<std::string> content_keys;
+	std::vector<double> data_keys;
+
+	if (identifier.empty()) {
+		if (by_data)
+			data_keys = items->flat_data();
+		else
+			content_keys = items->flat_content();
+	} else {
+		const Block key(line_number, column_number, content.back());
+		context.enter_scope();
+		for (std::size_t i = 0; i < items->size(); ++i) {
+			context.rebind(identifier, static_reference_cast<const Expression>
+				(items->at(i)));
+			if (by_data)
+				data_keys.push_back(key.evaluate(context)->get_data());
+			else
+				content_keys.push_back(key.evaluate(context)->get_content());
+		}
+		context.exit_scope();
+	}
+
+	const std::vector<std::size_t> order = by_data ? sort_data(data_keys)
+		: sort_content(content_keys);
+
+	Reference<List> result(new List(line_number, column_number));
+	result->reserve(order.size());
+	for (auto i = order.begin(); i != order.end(); ++i)
+		result->add(items->at(*i));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Split some content into a list at each occurrence of a separator, or into
+ * characters if the separator is empty.
+ */
+Reference<const List> Compound::evaluate_split
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 2)
+		throw std::runtime_error("Invalid use of \"split\".");
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::string separator = Block(line_number, column_number,
+		content[1]).evaluate(context)->get_content();
+	const std::vector<std::string> parts = text_split(text, separator);
+
+	Reference<List> result(new List(line_number, column_number));
+	for (auto i = parts.begin(); i != parts.end(); ++i)
+		result->add(Reference<const Value>(new Content
+			(line_number, column_number, *i)));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Replace every match of a regular expression in some content, where "\1"
+ * and so on in the replacement stand for groups.
+ */
+Reference<const List> Compound::evaluate_substitute
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 3)
+		throw std::runtime_error("Invalid use of \"substitute\".");
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const std::shared_ptr<const Regex> regex = Regex::compile(Block
+		(line_number, column_number, content[1]).evaluate(context)
+		->get_content());
+	const std::string replacement = Block(line_number, column_number,
+		content[2]).evaluate(context)->get_content();
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content
+		(line_number, column_number, regex->substitute(text, replacement))));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Take part of some content, by character position. A negative start counts
+ * from the end; without a count, the rest of the content is taken.
+ */
+Reference<const List> Compound::evaluate_substring
+	(const std::string& id, Context& context) const {
+
+	if (data.size() < 1 || data.size() > 2 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"substring\".");
+
+	double start = Block(line_number, column_number,
+		data[0]).evaluate(context)->get_data();
+	double count = data.size() == 2 ? Block(line_number, column_number,
+		data[1]).evaluate(context)->get_data() : -1;
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+
+	if (!std::isfinite(start) || !std::isfinite(count))
+		throw std::runtime_error("Invalid substring position.");
+
+	// No text has more characters than bytes, so positions past its size
+	// may as well be its size, and then they're sure to fit in a long.
+	const double size = text.size();
+	start = std::max(-size, std::min(start, size));
+	count = count < 0 ? -1 : std::min(count, size);
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content(line_number, column_number,
+		text_substring(text, long(start), long(count)))));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Transform some content with a simple text function.
+ */
+Reference<const List> Compound::evaluate_text
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 1) {
+		std::ostringstream message;
+		message << "Invalid use of \"" << id << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	const std::string text = Block(line_number, column_number,
+		content[0]).evaluate(context)->get_content();
+	const auto function = text_functions.find(id)->second;
+
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content
+		(line_number, column_number, function(text))));
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * Drop the elements of a list whose content is the same as that of an
+ * earlier element.
+ */
+Reference<const List> Compound::evaluate_unique
+	(const std::string& id, Context& context) const {
+
+	if (data.size() != 0 || content.size() != 1)
+		throw std::runtime_error("Invalid use of \"unique\".");
+
+	const Reference<const List> items = Block(line_number, column_number,
+		content[0]).evaluate(context);
+	const std::vector<std::string> keys = items->flat_content();
+	std::unordered_set<std::string> seen(keys.size());
+
+	Reference<List> result(new List(line_number, column_number));
+	for (std::size_t i = 0; i < keys.size(); ++i)
+		if (seen.insert(keys[i]).second)
+			result->add(items->at(i));
+	return static_reference_cast<const List>(result);
+
+}
+
+
 /**
  * Import a module.
  */
-std::shared_ptr<const List> Compound::evaluate_use
+Reference<const List> Compound::evaluate_use
 	(const std::string& id, Context& context) const {
 
 	std::string name;
@@ -579,7 +1544,7 @@ std::shared_ptr<const List> Compound::evaluate_use
 		name = Block(line_number, column_number, content[0]).evaluate
 			(context)->get_content();
 	else if (!identifier.empty() && content.empty() && data.empty())
-		name = identifier;
+		name = identifier.string();
 	else
 		throw std::runtime_error("Invalid use of \"use\".");
 
@@ -595,14 +1560,20 @@ std::shared_ptr<const List> Compound::evaluate_use
 	const Scanner scanner(file);
 	const Parser parser(scanner);
 	Interpreter interpreter(parser, output);
+	interpreter.context.direct_mode = context.direct_mode;
+	interpreter.context.cache = context.cache;
+	interpreter.context.scheduler = context.scheduler;
 	interpreter.run();
 	context.inject(interpreter.context);
 	context.head_buffer << interpreter.context.head_buffer.str();
+	context.sources.insert(name);
+	context.sources.insert(interpreter.context.sources.begin(),
+		interpreter.context.sources.end());
 
-	std::shared_ptr<List> result(new List(line_number, column_number));
-	result->add(std::shared_ptr<const Value>(new Content
+	Reference<List> result(new List(line_number, column_number));
+	result->add(Reference<const Value>(new Content
 		(line_number, column_number, output.str())));
-	return std::static_pointer_cast<const List>(result);
+	return static_reference_cast<const List>(result);
 
 }
 
@@ -610,11 +1581,11 @@ std::shared_ptr<const List> Compound::evaluate_use
 /**
  * Import a namespace prefix into the current scope.
  */
-std::shared_ptr<const List> Compound::evaluate_using
+Reference<const List> Compound::evaluate_using
 	(const std::string& id, Context& context) const {
 
 	context.use(identifier);
-	return std::shared_ptr<const List>(new List(line_number, column_number));
+	return Reference<const List>(new List(line_number, column_number));
 
 }
 
@@ -622,7 +1593,7 @@ std::shared_ptr<const List> Compound::evaluate_using
 /**
  * Complain with a user-defined warning message, or die if in pedantic mode.
  */
-std::shared_ptr<const List> Compound::evaluate_warn
+Reference<const List> Compound::evaluate_warn
 	(const std::string& id, Context& context) const {
 
 	if (data.size() != 0 || content.size() != 1)
@@ -637,7 +1608,7 @@ std::shared_ptr<const List> Compound::evaluate_warn
 		std::cerr << "Warning: " << message << '\n';
 	}
 
-	return std::shared_ptr<const List>(new List(line_number, column_number));
+	return Reference<const List>(new List(line_number, column_number));
 
 }
 
@@ -658,3 +1629,26 @@ double Compound::get_data() const {
 	throw std::logic_error
 		("Attempt to get data from compound expression without context.");
 }
+
+
+/**
+ * Write the parts of a Compound in the order that Image::read_expression will
+ * want to put them back together.
+ */
+void Compound::write(Image& image) const {
+
+	image.write_tag(Image::COMPOUND);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_expression(determiner);
+	image.write_symbol(identifier);
+
+	image.write_integer(data.size());
+	for (auto i = data.begin(); i != data.end(); ++i)
+		image.write_expressions(*i);
+
+	image.write_integer(content.size());
+	for (auto i = content.begin(); i != content.end(); ++i)
+		image.write_expressions(*i);
+
+}
@@ -1,11 +1,16 @@
 #ifndef COMPOUND_H
 #define COMPOUND_H
 #include "Expression.h"
+#include "Reference.h"
+#include "Symbol.h"
+#include <cstddef>
 #include <map>
-#include <memory>
 #include <vector>
 
 
+class Builder;
+
+
 /**
  * A compound Expression representing either a keyword application or template
  * invocation. Encapsulates a determiner Expression, an optional string
@@ -17,51 +22,86 @@ public:
 	Compound(int, int);
 	virtual ~Compound();
 
-	void set_determiner(std::shared_ptr<const Expression>);
-	void set_identifier(const std::string&);
+	void set_determiner(Reference<const Expression>);
+	void set_identifier(Symbol);
 
 	void add_data();
-	void add_data(std::shared_ptr<const Expression>);
+	void add_data(Reference<const Expression>);
 	void add_content();
-	void add_content(std::shared_ptr<const Expression>);
+	void add_content(Reference<const Expression>);
 
-	virtual std::shared_ptr<const List> evaluate(Context&) const;
+	virtual Reference<const List> evaluate(Context&) const;
 	virtual std::string get_content() const;
 	virtual double get_data() const;
+	virtual void write(Image&) const;
 
 	typedef double(MathFunction)(const std::vector<double>&);
 
 private:
 
-	typedef std::shared_ptr<const List>(Evaluator)
+	typedef Reference<const List>(Evaluator)
 		(const std::string&, Context&) const;
-	typedef std::shared_ptr<const List>
+	typedef Reference<const List>
 		(Compound::*EvaluatorPointer)(const std::string&, Context&) const;
 	typedef double(*MathFunctionPointer)(const std::vector<double>&);
+	typedef void(*MathKernelPointer)(const double*, const double*, double*,
+		std::size_t);
+	typedef std::string(*TextFunctionPointer)(const std::string&);
 
+	Evaluator evaluate_append;
+	Evaluator evaluate_builder;
+	Evaluator evaluate_concat;
 	Evaluator evaluate_def;
+	Evaluator evaluate_dict;
 	Evaluator evaluate_error;
 	Evaluator evaluate_extern;
 	Evaluator evaluate_file;
+	Evaluator evaluate_finish;
+	Evaluator evaluate_for;
+	Evaluator evaluate_get;
+	Evaluator evaluate_has;
 	Evaluator evaluate_header;
 	Evaluator evaluate_if;
+	Evaluator evaluate_join;
+	Evaluator evaluate_json;
+	Evaluator evaluate_keys;
+	Evaluator evaluate_length;
+	Evaluator evaluate_load;
 	Evaluator evaluate_local;
+	Evaluator evaluate_match;
 	Evaluator evaluate_math;
 	Evaluator evaluate_namespace;
+	Evaluator evaluate_nth;
+	Evaluator evaluate_range;
+	Evaluator evaluate_reduce;
+	Evaluator evaluate_replace;
+	Evaluator evaluate_reverse;
+	Evaluator evaluate_search;
+	Evaluator evaluate_slice;
+	Evaluator evaluate_sort;
+	Evaluator evaluate_split;
+	Evaluator evaluate_substitute;
+	Evaluator evaluate_substring;
+	Evaluator evaluate_text;
+	Evaluator evaluate_unique;
 	Evaluator evaluate_use;
 	Evaluator evaluate_using;
 	Evaluator evaluate_warn;
 
-	std::shared_ptr<const Expression> determiner;
-	std::string identifier;
-	std::vector<std::vector<std::shared_ptr<const Expression>>> data;
-	std::vector<std::vector<std::shared_ptr<const Expression>>> content;
+	Reference<const Expression> determiner;
+	Symbol identifier;
+	std::vector<std::vector<Reference<const Expression>>> data;
+	std::vector<std::vector<Reference<const Expression>>> content;
 
-	static bool is_keyword(const std::string&);
+	static bool is_keyword(Symbol);
+	Reference<const List> name_value(Context&, Reference<const Value>) const;
+	Reference<const Builder> find_builder(Context&) const;
 
-	static std::map<std::string, EvaluatorPointer> evaluators;
+	static std::map<Symbol, EvaluatorPointer> evaluators;
 	static std::map<std::string, int> math_arities;
 	static std::map<std::string, MathFunctionPointer> math_functions;
+	static std::map<std::string, MathKernelPointer> math_kernels;
+	static std::map<std::string, TextFunctionPointer> text_functions;
 
 };
 
@@ -1,6 +1,11 @@
 #include "Content.h"
+#include "Image.h"
 #include "List.h"
-#include <sstream>
+#include "Mapping.h"
+#include "Output.h"
+#include <cstdlib>
+#include <ostream>
+#include <utility>
 
 #include <iostream>
 
@@ -9,20 +14,37 @@ Content::Content(int line, int column, const std::string& value) :
 	Value(line, column), value(value) {}
 
 
+/**
+ * Content that takes over a string, for those who have one to spare.
+ */
+Content::Content(int line, int column, std::string&& value) :
+	Value(line, column), value(std::move(value)) {}
+
+
+/**
+ * Content backed by a mapped file, which is shared rather than copied.
+ */
+Content::Content(int line, int column,
+	std::shared_ptr<const Mapping> mapping) : Value(line, column),
+	mapping(mapping) {}
+
+
 Content::~Content() {}
 
 
 /**
  * A string Value as a List is just a List of just that Value.
  */
-std::shared_ptr<const List> Content::evaluate(Context&) const {
-	std::shared_ptr<List> result(new List(line_number, column_number));
+Reference<const List> Content::evaluate(Context&) const {
+	Reference<List> result(new List(line_number, column_number));
 	result->add(self_reference());
-	return std::static_pointer_cast<const List>(result);
+	return static_reference_cast<const List>(result);
 }
 
 
-std::string Content::get_content() const { return value; }
+std::string Content::get_content() const {
+	return mapping ? std::string(mapping->data(), mapping->size()) : value;
+}
 
 
 /**
@@ -30,13 +52,38 @@ std::string Content::get_content() const { return value; }
  * Vision doesn't directly support, such as scientific notation, simply by
  * quoting them and relying on runtime conversion. Of course, the conversion
  * can fail, and it does so silently, making that not the best idea ever.
+ *
+ * This happens for every element whenever a List is used as data, so it goes
+ * straight to strtod rather than through a stream.
  */
 double Content::get_data() const {
-	std::istringstream stream(value);
-	double result;
-	if (stream >> result)
-		return result;
-	return 0;
+	return std::strtod(mapping ? get_content().c_str() : value.c_str(),
+		nullptr);
+}
+
+
+
+void Content::write(Image& image) const {
+	image.write_tag(Image::CONTENT);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_string(get_content());
+}
+
+
+/**
+ * File-backed content going straight to an Output is handed over by
+ * descriptor, so that it never has to be read at all.
+ */
+void Content::write_content(std::ostream& stream) const {
+	if (!mapping) {
+		stream << value;
+	} else if (Output* output = dynamic_cast<Output*>(stream.rdbuf())) {
+		if (!output->send(*mapping))
+			stream.setstate(std::ios::badbit);
+	} else {
+		stream.write(mapping->data(), mapping->size());
+	}
 }
 
 
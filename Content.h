@@ -1,9 +1,13 @@
 #ifndef CONTENT_H
 #define CONTENT_H
 #include "Value.h"
+#include <memory>
 #include <string>
 
 
+class Mapping;
+
+
 /**
  * A string Value.
  */
@@ -11,11 +15,15 @@ class Content : public Value {
 public:
 
 	Content(int, int, const std::string&);
+	Content(int, int, std::string&&);
+	Content(int, int, std::shared_ptr<const Mapping>);
 	virtual ~Content();
 
-	virtual std::shared_ptr<const List> evaluate(Context&) const;
+	virtual Reference<const List> evaluate(Context&) const;
 	virtual std::string get_content() const;
 	virtual double get_data() const;
+	virtual void write(Image&) const;
+	virtual void write_content(std::ostream&) const;
 
 protected:
 
@@ -24,6 +32,7 @@ protected:
 private:
 
 	std::string value;
+	std::shared_ptr<const Mapping> mapping;
 
 };
 
@@ -1,48 +1,194 @@
 #include "Context.h"
+#include "Cache.h"
+#include "Image.h"
 #include "List.h"
+#include "Mapping.h"
+#include "Scheduler.h"
 #include <iostream>
 #include <stdexcept>
+#include <sys/stat.h>
 
 
-Context::Context() : head_mode(false), silent_mode(false), pedantic_mode(false),
-	tab_size(4), stack{Scope("global")} {}
+Context::Context() : direct_mode(false), head_mode(false), silent_mode(false),
+	pedantic_mode(false), tab_size(4), generation(0),
+	global(new Namespace("global", nullptr, 0)) {
+	stack.push_front(Scope(global.get()));
+}
+
+
+/**
+ * Find or create the child Namespace with a given (possibly qualified) name. A
+ * new child is linked to its counterparts in the parent's imports.
+ */
+Context::Namespace* Context::open(Namespace& space, Symbol name) {
+
+	if (name.empty()) return &space;
+
+	const auto parts = Symbol::split(name);
+	Namespace* const outer = open(space, parts.first);
+	auto& result = outer->children[parts.second];
+
+	if (!result) {
+		result.reset(new Namespace(parts.second, outer, generation));
+		if (recording(*outer))
+			changes.push_back({Change::CHILD, outer, parts.second});
+		for (auto i = outer->imports.begin(); i != outer->imports.end(); ++i)
+			link_child(*result, *i);
+	}
+
+	return result.get();
+
+}
+
+
+/**
+ * Link an immutable Namespace into another, and its children into the
+ * children of the same name.
+ */
+void Context::link(Namespace& target,
+	const std::shared_ptr<const Namespace>& source) {
+	if (recording(target))
+		changes.push_back({Change::IMPORT, &target});
+	target.imports.push_back(source);
+	for (auto i = target.children.begin(); i != target.children.end(); ++i)
+		link_child(*i->second, source);
+}
+
+
+/**
+ * Link the counterpart of a Namespace from an import of its parent. If the
+ * import has no child of that name, its own imports might. The link shares
+ * ownership of the whole imported tree.
+ */
+void Context::link_child(Namespace& target,
+	const std::shared_ptr<const Namespace>& source) {
+	auto counterpart = source->children.find(target.name);
+	if (counterpart != source->children.end()) {
+		link(target, std::shared_ptr<const Namespace>
+			(source, counterpart->second.get()));
+	} else {
+		for (auto i = source->imports.begin(); i != source->imports.end(); ++i)
+			link_child(target, std::shared_ptr<const Namespace>
+				(source, i->get()));
+	}
+}
+
+
+/**
+ * Collect this Namespace followed by everything it imports, in lookup order.
+ */
+void Context::Namespace::view(std::vector<const Namespace*>& result) const {
+	result.push_back(this);
+	for (auto i = imports.begin(); i != imports.end(); ++i)
+		(*i)->view(result);
+}
+
+
+/**
+ * Collect the canonical names of everything defined in this tree under a given
+ * prefix, excluding imports.
+ */
+void Context::Namespace::own_names(Symbol prefix,
+	std::set<Symbol>& result) const {
+	for (auto i = symbols.begin(); i != symbols.end(); ++i)
+		for (auto j = i->second.begin(); j != i->second.end(); ++j)
+			result.insert(Symbol::qualify(prefix, j->first.canonical));
+	for (auto i = children.begin(); i != children.end(); ++i)
+		i->second->own_names(Symbol::qualify(prefix, i->first), result);
+}
+
+
+/**
+ * The canonical names of everything visible in this tree, including imports.
+ * Only meaningful for Namespaces that have stopped changing, which is all that
+ * it is used for, so it is computed once and kept.
+ */
+const std::set<Symbol>& Context::Namespace::names() const {
+	if (!flat) {
+		std::unique_ptr<std::set<Symbol>> result(new std::set<Symbol>);
+		own_names(Symbol(), *result);
+		for (auto i = imports.begin(); i != imports.end(); ++i)
+			result->insert((*i)->names().begin(), (*i)->names().end());
+		flat.reset(result.release());
+	}
+	return *flat;
+}
+
+
+/**
+ * The qualified name of a Namespace, for the benefit of error messages.
+ */
+Symbol Context::Namespace::path() const {
+	if (!parent || parent->name.empty() || !parent->parent)
+		return name;
+	return Symbol::qualify(parent->path(), name);
+}
 
 
 /**
  * Define a symbol with a particular Signature in the current scope. If
  * redefinition is explicitly allowed (as it might have to be for internals),
- * shut up about redefined symbols.
+ * shut up about redefined symbols. Enclosing namespaces see the definition by
+ * way of the namespace tree, so this touches exactly one table.
  */
 void Context::define(const Signature& signature,
-	std::shared_ptr<const Expression> body, bool allow_redefinition) {
+	Reference<const Expression> body, bool allow_redefinition) {
+	insert(*open(*stack.front().space, Symbol::split(signature.name).first),
+		signature.unqualified(), body, allow_redefinition);
+}
+
+
+/**
+ * Define an unqualified Signature directly in a Namespace.
+ */
+void Context::insert(Namespace& space, const Signature& signature,
+	Reference<const Expression> body, bool allow_redefinition) {
 
 	if (!allow_redefinition) {
-		auto position = stack.front().symbols.find(signature);
-		if (position != stack.front().symbols.end()) {
+		if (const Signature* const previous = find(space, signature)) {
 			std::ostringstream message;
 			message << "Redefinition of \"" << signature.name
 				<< "\"";
-			if (!stack.front().name.empty())
-				message << " in namespace \"" << stack.front().name << "\"";
-			message << " already defined as \"" << position->first.canonical
+			if (!space.name.empty())
+				message << " in namespace \"" << space.path() << "\"";
+			message << " already defined as \"" << previous->canonical
 				<< "\".";
 			throw std::runtime_error(message.str());
 		}
 	}
 
-	stack.front().symbols[signature] = body;
+	auto& overloads = space.symbols[signature.name];
+	auto position = overloads.find(signature);
 
-	std::string qualified = signature.name;
+	if (recording(space))
+		changes.push_back({Change::DEFINE, &space, signature.name,
+			signature.canonical, position == overloads.end() ?
+			Reference<const Expression>() : position->second});
 
-	auto frame = stack.begin();
-	auto previous = frame++;
-	while (frame != stack.end() && !previous->name.empty()) {
-		qualified = previous->name + "::" + qualified;
-		Signature prefixed(qualified, signature);
-		frame->symbols[prefixed] = body;
-		previous = frame++;
-	}
+	if (position == overloads.end())
+		overloads.insert({signature, body});
+	else
+		position->second = body;
+
+}
 
+
+/**
+ * Find a definition with the same canonical Signature in a Namespace or in
+ * anything it imports.
+ */
+const Signature* Context::find(const Namespace& space,
+	const Signature& signature) {
+	auto overloads = space.symbols.find(signature.name);
+	if (overloads != space.symbols.end()) {
+		auto position = overloads->second.find(signature);
+		if (position != overloads->second.end())
+			return &position->first;
+	}
+	for (auto i = space.imports.begin(); i != space.imports.end(); ++i)
+		if (const Signature* const result = find(**i, signature))
+			return result;
+	return nullptr;
 }
 
 
@@ -50,16 +196,21 @@ void Context::define(const Signature& signature,
  * Shorthand for redefining a symbol.
  */
 void Context::redefine(const Signature& signature,
-	std::shared_ptr<const Expression> body) {
+	Reference<const Expression> body) {
 	define(signature, body, true);
 }
 
 
 /**
- * Enter a new scope or namespace scope.
+ * Enter a new scope or namespace scope. Named scopes reopen the namespace of
+ * the same name in the current scope, if there already is one.
  */
-void Context::enter_scope(const std::string& name) {
-	stack.push_front(Scope(name));
+void Context::enter_scope(Symbol name) {
+	if (name.empty())
+		stack.push_front(Scope(std::unique_ptr<Namespace>
+			(new Namespace(name, stack.front().space, generation))));
+	else
+		stack.push_front(Scope(open(*stack.front().space, name)));
 }
 
 
@@ -71,51 +222,183 @@ void Context::exit_scope() {
 }
 
 
+/**
+ * Bind a name in the current anonymous scope, forgetting anything else that
+ * was defined there. This lets a loop reuse one scope for every iteration:
+ * in the usual case, where the body defines nothing of its own, the binding
+ * is simply replaced in place.
+ */
+void Context::rebind(Symbol name, Reference<const Expression> body) {
+
+	if (!stack.front().local)
+		throw std::logic_error("Attempt to rebind outside of a local scope.");
+
+	Namespace& space = *stack.front().space;
+	const Signature signature(name);
+
+	if (space.symbols.size() == 1 && space.children.empty()
+		&& space.imports.empty() && space.use.size() == 1 && !space.provider) {
+		auto overloads = space.symbols.find(name);
+		if (overloads != space.symbols.end()
+			&& overloads->second.size() == 1) {
+			auto position = overloads->second.find(signature);
+			if (position != overloads->second.end()) {
+				position->second = body;
+				return;
+			}
+		}
+	}
+
+	stack.front().local.reset(new Namespace(Symbol(), space.parent,
+		generation));
+	stack.front().space = stack.front().local.get();
+	stack.front().space->symbols[name].insert({signature, body});
+
+}
+
+
 /**
  * Inject all definitions from an alien Context into the current Context. This
  * is basically what makes libraries and metaprogramming at all possible. Any
  * namespace prefixes that the alien Context has specified will be injected.
- * Redefinition of names is left disabled, just in case.
+ *
+ * The alien symbol table is not copied, but linked in by reference and shared
+ * from then on, so the alien Context must not change afterwards. Definitions
+ * made here later shadow it rather than modifying it. Redefinition of names is
+ * still disallowed, and is checked against the precomputed set of names in
+ * each table, iterating over whichever is smaller.
  */
 void Context::inject(const Context& context) {
-	for (auto i = context.stack.front().symbols.begin();
-		i != context.stack.front().symbols.end(); ++i)
-		define(i->first, i->second);
-	stack.front().use.insert
-		(context.stack.front().use.begin(), context.stack.front().use.end());
+
+	Namespace& space = *stack.front().space;
+	const std::set<Symbol>& incoming = context.global->names();
+
+	std::set<Symbol> own;
+	space.own_names(Symbol(), own);
+
+	std::vector<const std::set<Symbol>*> existing{&own};
+	for (auto i = space.imports.begin(); i != space.imports.end(); ++i)
+		existing.push_back(&(*i)->names());
+
+	for (auto i = existing.begin(); i != existing.end(); ++i) {
+		const auto& smaller = (*i)->size() < incoming.size() ? **i : incoming;
+		const auto& larger = (*i)->size() < incoming.size() ? incoming : **i;
+		for (auto j = smaller.begin(); j != smaller.end(); ++j) {
+			if (larger.find(*j) != larger.end()) {
+				std::ostringstream message;
+				message << "Redefinition of \"" << *j << "\"";
+				if (!space.name.empty())
+					message << " in namespace \"" << space.path() << "\"";
+				message << " by library.";
+				throw std::runtime_error(message.str());
+			}
+		}
+	}
+
+	link(space, context.global);
+	for (auto i = context.global->use.begin();
+		i != context.global->use.end(); ++i)
+		if (space.use.insert(*i).second && recording(space))
+			changes.push_back({Change::USE, &space, *i});
+
+}
+
+
+/**
+ * Collect the tables that a (possibly qualified) namespace path refers to from
+ * a given Namespace, in lookup order. The first is the Namespace's own table,
+ * or null if there is none; because own tables are linked to their imported
+ * counterparts, only paths that exist solely in imports need the slow way.
+ */
+void Context::resolve(const Namespace& space, Symbol path,
+	std::vector<const Namespace*>& result) {
+
+	if (path.empty()) {
+		space.view(result);
+		return;
+	}
+
+	const auto parts = Symbol::split(path);
+	resolve(space, parts.first, result);
+
+	if (result.front()) {
+		auto own = result.front()->children.find(parts.second);
+		if (own != result.front()->children.end()) {
+			result.clear();
+			own->second->view(result);
+			return;
+		}
+	}
+
+	std::vector<const Namespace*> next{nullptr};
+	for (auto i = result.begin() + 1; i != result.end(); ++i) {
+		auto child = (*i)->children.find(parts.second);
+		if (child != (*i)->children.end())
+			child->second->view(next);
+	}
+	result.swap(next);
+
 }
 
 
 /**
  * Add a namespace to the set of imported namespaces.
  */
-void Context::use(const std::string& prefix) {
-	stack.front().use.insert(prefix);
+void Context::use(Symbol prefix) {
+	Namespace& space = *stack.front().space;
+	if (space.use.insert(prefix).second && recording(space))
+		changes.push_back({Change::USE, &space, prefix});
+}
+
+
+/**
+ * Set the Provider of the current Namespace, replacing any previous one.
+ */
+void Context::provide(Provider provider) {
+	Namespace& space = *stack.front().space;
+	if (recording(space))
+		changes.push_back({Change::PROVIDE, &space, Symbol(), Symbol(),
+			Reference<const Expression>(), space.provider});
+	space.provider = provider;
 }
 
 
 /**
  * Evaluate a Compound Expression defined in the current scope given its name
  * and parameters. After all the bookkeeping is done, enter a new scope, bind
- * the signature to the parameters, evaluate, and exit.
+ * the signature to the parameters, evaluate, and exit. A nullary name that no
+ * table defines may yet be made up by the table's Provider.
  */
-std::shared_ptr<const List> Context::evaluate(const std::string& name,
+Reference<const List> Context::evaluate(Symbol name,
 	const std::vector<std::vector<double>>& data,
 	const std::vector<std::vector<std::string>>& content) {
 
 	auto scope = stack.begin();
-	std::map<Signature, std::shared_ptr<const Expression>>::const_iterator pair;
+	Overloads::const_iterator pair;
+	Reference<const Expression> provided;
+	const bool nullary = data.empty() && content.empty();
 
 	while (scope != stack.end()) {
-		for (auto prefix = scope->use.begin();
-			prefix != scope->use.end(); ++prefix) {
-			pair = scope->symbols.begin();
-			while (pair != scope->symbols.end()) {
-				std::string qualified =
-					prefix->empty() ? name : *prefix + "::" + name;
-				if (pair->first.matches(qualified, data, content))
-					goto found;
-				++pair;
+		const Namespace& space = *scope->space;
+		for (auto prefix = space.use.begin();
+			prefix != space.use.end(); ++prefix) {
+			const auto parts = Symbol::split(Symbol::qualify(*prefix, name));
+			candidates.clear();
+			resolve(space, parts.first, candidates);
+			for (auto table = candidates.begin();
+				table != candidates.end(); ++table) {
+				if (!*table) continue;
+				auto overloads = (*table)->symbols.find(parts.second);
+				if (overloads == (*table)->symbols.end()) {
+					if (nullary && (*table)->provider
+						&& (provided = (*table)->provider(parts.second)))
+						return provided->evaluate(*this);
+					continue;
+				}
+				for (pair = overloads->second.begin();
+					pair != overloads->second.end(); ++pair)
+					if (pair->first.matches(data, content))
+						goto found;
 			}
 		}
 		++scope;
@@ -131,16 +414,277 @@ std::shared_ptr<const List> Context::evaluate(const std::string& name,
 		message << "\".";
 		// throw std::runtime_error(message.str());
 		std::cerr << message.str() << '\n';
-		return std::shared_ptr<const List>(new List(0, 0));
+		return Reference<const List>(new List(0, 0));
 	}
 
 found:
 
 	enter_scope();
 	pair->first.bind(*this, data, content);
-	std::shared_ptr<const List> result(pair->second->evaluate(*this));
+	Reference<const List> result(pair->second->evaluate(*this));
 	exit_scope();
 
 	return result;
 
 }
+
+
+/**
+ * Take a snapshot of the Context, to which it can later be restored. This is
+ * constant-time: it just starts a new generation, so that changes to any
+ * Namespace that already exists get recorded in the undo log from now on. The
+ * snapshot can only be taken outside of any local scope, since an anonymous
+ * scope and everything in it is gone by the time it could be restored.
+ */
+Context::Snapshot Context::snapshot() {
+
+	std::vector<Namespace*> frames;
+	for (auto i = stack.begin(); i != stack.end(); ++i) {
+		if (i->local)
+			throw std::logic_error("Attempt to take snapshot in local scope.");
+		frames.push_back(i->space);
+	}
+
+	const Snapshot id = marks.empty() ? 1 : marks.back().id + 1;
+	marks.push_back({id, changes.size(), head_buffer.str().size(), frames});
+	++generation;
+	return id;
+
+}
+
+
+/**
+ * Restore the Context to a snapshot by undoing everything in the log since it
+ * was taken, in time proportional to the number of changes. Snapshots taken
+ * after this one are invalidated, but this one remains valid, so the same
+ * Context can be restored to the same state over and over.
+ */
+void Context::restore(Snapshot id) {
+
+	auto mark = marks.begin();
+	while (mark != marks.end() && mark->id != id)
+		++mark;
+
+	if (mark == marks.end())
+		throw std::logic_error("Attempt to restore invalid snapshot.");
+
+	while (changes.size() > mark->changes) {
+
+		Change& change = changes.back();
+		Namespace& space = *change.space;
+
+		switch (change.type) {
+
+		case Change::DEFINE:
+			{
+				auto overloads = space.symbols.find(change.name);
+				auto position = overloads->second.find
+					(Signature(change.canonical));
+				if (change.previous) {
+					position->second = change.previous;
+				} else {
+					overloads->second.erase(position);
+					if (overloads->second.empty())
+						space.symbols.erase(overloads);
+				}
+			}
+			break;
+
+		case Change::CHILD:
+			space.children.erase(change.name);
+			break;
+
+		case Change::IMPORT:
+			space.imports.pop_back();
+			break;
+
+		case Change::PROVIDE:
+			space.provider = change.provider;
+			break;
+
+		case Change::USE:
+			space.use.erase(change.name);
+			break;
+
+		}
+
+		changes.pop_back();
+
+	}
+
+	stack.clear();
+	for (auto i = mark->frames.rbegin(); i != mark->frames.rend(); ++i)
+		stack.push_front(Scope(*i));
+
+	const std::string head = head_buffer.str();
+	if (head.size() != mark->head_size) {
+		head_buffer.str(head.substr(0, mark->head_size));
+		head_buffer.seekp(0, std::ios::end);
+	}
+
+	marks.erase(mark + 1, marks.end());
+
+}
+
+
+/**
+ * Forget a snapshot that won't be restored. Once no snapshots are left, the
+ * undo log is dropped and changes are no longer recorded.
+ */
+void Context::release(Snapshot id) {
+
+	auto mark = marks.begin();
+	while (mark != marks.end() && mark->id != id)
+		++mark;
+
+	if (mark == marks.end())
+		throw std::logic_error("Attempt to release invalid snapshot.");
+
+	marks.erase(mark);
+	if (marks.empty())
+		changes.clear();
+
+}
+
+
+/**
+ * Write the global symbol table and header buffer to an Image. Imports are
+ * folded into the tables that import them, so that the image loads as one
+ * plain tree.
+ */
+void Context::write(Image& image) const {
+	image.write_string(head_buffer.str());
+	write_namespace(image, {global.get()});
+}
+
+
+/**
+ * Read the global symbol table and header buffer back from an Image, on top of
+ * whatever is already defined.
+ */
+void Context::read(Image& image) {
+	head_buffer << image.read_string();
+	read_namespace(image, *global);
+}
+
+
+/**
+ * Write the union of some tables and everything they import, in lookup order,
+ * as a single table. Earlier definitions shadow later ones, just as they do
+ * in Context::evaluate.
+ */
+void Context::write_namespace(Image& image,
+	const std::vector<const Namespace*>& heads) {
+
+	std::vector<const Namespace*> tables;
+	for (auto i = heads.begin(); i != heads.end(); ++i)
+		(*i)->view(tables);
+
+	std::set<Symbol> use;
+	std::map<Symbol, Overloads> symbols;
+	std::map<Symbol, std::vector<const Namespace*>> children;
+	std::set<const Namespace*> seen;
+
+	for (auto i = tables.begin(); i != tables.end(); ++i) {
+		if (!seen.insert(*i).second) continue;
+		use.insert((*i)->use.begin(), (*i)->use.end());
+		for (auto j = (*i)->symbols.begin(); j != (*i)->symbols.end(); ++j)
+			symbols[j->first].insert(j->second.begin(), j->second.end());
+		for (auto j = (*i)->children.begin(); j != (*i)->children.end(); ++j)
+			children[j->first].push_back(j->second.get());
+	}
+
+	image.write_integer(use.size());
+	for (auto i = use.begin(); i != use.end(); ++i)
+		image.write_symbol(*i);
+
+	image.write_integer(symbols.size());
+	for (auto i = symbols.begin(); i != symbols.end(); ++i) {
+		image.write_symbol(i->first);
+		image.write_integer(i->second.size());
+		for (auto j = i->second.begin(); j != i->second.end(); ++j) {
+			const Signature& signature = j->first;
+			image.write_symbol(signature.canonical);
+			for (auto k : {&signature.data, &signature.content}) {
+				image.write_integer(k->size());
+				for (auto l = k->begin(); l != k->end(); ++l) {
+					image.write_integer(l->second);
+					image.write_integer(l->first.size());
+					for (auto m = l->first.begin(); m != l->first.end(); ++m)
+						image.write_symbol(*m);
+				}
+			}
+			image.write_expression(j->second);
+		}
+	}
+
+	image.write_integer(children.size());
+	for (auto i = children.begin(); i != children.end(); ++i) {
+		image.write_symbol(i->first);
+		write_namespace(image, i->second);
+	}
+
+}
+
+
+/**
+ * Read a table written by write_namespace into a Namespace.
+ */
+void Context::read_namespace(Image& image, Namespace& space) {
+
+	for (int64_t i = image.read_integer(); i > 0; --i) {
+		const Symbol name = image.read_symbol();
+		if (space.use.insert(name).second && recording(space))
+			changes.push_back({Change::USE, &space, name});
+	}
+
+	for (int64_t i = image.read_integer(); i > 0; --i) {
+		Signature signature(image.read_symbol());
+		for (int64_t j = image.read_integer(); j > 0; --j) {
+			signature.canonical = image.read_symbol();
+			for (auto k : {&signature.data, &signature.content}) {
+				k->clear();
+				for (int64_t l = image.read_integer(); l > 0; --l) {
+					const bool variadic = image.read_integer();
+					std::vector<Symbol> names;
+					for (int64_t m = image.read_integer(); m > 0; --m)
+						names.push_back(image.read_symbol());
+					k->push_back({names, variadic});
+				}
+			}
+			insert(space, signature, image.read_expression(), false);
+		}
+	}
+
+	for (int64_t i = image.read_integer(); i > 0; --i) {
+		const Symbol name = image.read_symbol();
+		read_namespace(image, *open(space, name));
+	}
+
+}
+
+
+/**
+ * Map a file, or share the existing mapping if the file hasn't changed since
+ * it was last mapped in this Context. Returns null if there's no such file.
+ */
+std::shared_ptr<const Mapping> Context::map(const std::string& path) {
+
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) {
+		files.erase(path);
+		return nullptr;
+	}
+
+	auto existing = files.find(path);
+	if (existing != files.end() && existing->second->matches(status))
+		return existing->second;
+
+	std::shared_ptr<const Mapping> result = Mapping::open(path);
+	if (result)
+		files[path] = result;
+	else
+		files.erase(path);
+	return result;
+
+}
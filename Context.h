@@ -1,14 +1,24 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 #include "Expression.h"
+#include "Reference.h"
 #include "Signature.h"
+#include "Symbol.h"
 #include "Value.h"
+#include <functional>
 #include <iosfwd>
 #include <list>
 #include <map>
 #include <memory>
-#include <vector>
 #include <set>
+#include <sstream>
+#include <vector>
+
+
+class Cache;
+class Image;
+class Mapping;
+class Scheduler;
 
 
 /**
@@ -19,45 +29,170 @@ public:
 
 	Context();
 
-	void define(const Signature&, std::shared_ptr<const Expression>,
+	void define(const Signature&, Reference<const Expression>,
 		bool = false);
-	void redefine(const Signature&, std::shared_ptr<const Expression>);
+	void redefine(const Signature&, Reference<const Expression>);
+
+	typedef std::function<Reference<const Expression>(Symbol)> Provider;
 
-	void enter_scope(const std::string& = "");
+	void enter_scope(Symbol = Symbol());
 	void exit_scope();
+	void rebind(Symbol, Reference<const Expression>);
 	void inject(const Context&);
-	void use(const std::string&);
+	void use(Symbol);
+	void provide(Provider);
 
-	std::shared_ptr<const List> evaluate(const std::string&,
+	Reference<const List> evaluate(Symbol,
 		const std::vector<std::vector<double>>& =
 		std::vector<std::vector<double>>(),
 		const std::vector<std::vector<std::string>>& =
 		std::vector<std::vector<std::string>>());
 
+	typedef unsigned int Snapshot;
+
+	Snapshot snapshot();
+	void restore(Snapshot);
+	void release(Snapshot);
+
+	void write(Image&) const;
+	void read(Image&);
+
+	std::shared_ptr<const Mapping> map(const std::string&);
+
+	bool direct_mode;
 	bool head_mode;
 	bool indent_mode;
 	bool pedantic_mode;
 	bool silent_mode;
 	int tab_size;
 	std::ostringstream head_buffer;
+	std::shared_ptr<Cache> cache;
+	std::shared_ptr<Scheduler> scheduler;
+	std::set<std::string> sources;
 
 private:
 
+	/**
+	 * All overloads of one name, keyed by canonical Signature.
+	 */
+	typedef std::map<Signature, Reference<const Expression>> Overloads;
+
+	/**
+	 * A symbol table, with one child table for each nested namespace. Each
+	 * definition lives in exactly one table, and qualified names are resolved
+	 * by walking down the tree one prefix at a time. Libraries are linked in
+	 * by reference as imports, which are consulted after the table's own
+	 * definitions and never modified; an import of this table's parent that
+	 * has a child of the same name as this table is linked here as well.
+	 *
+	 * A table can also have a Provider, which is asked for a nullary
+	 * definition of any name that the table itself doesn't define, so that
+	 * large sets of definitions can be made up only as they're used.
+	 */
+	struct Namespace {
+
+		Namespace(Symbol name, Namespace* parent, unsigned int generation)
+			: name(name), parent(parent), generation(generation),
+			use{Symbol()} {}
+
+		void view(std::vector<const Namespace*>&) const;
+		void own_names(Symbol, std::set<Symbol>&) const;
+		const std::set<Symbol>& names() const;
+		Symbol path() const;
+
+		Symbol name;
+		Namespace* parent;
+		unsigned int generation;
+		std::map<Symbol, Overloads> symbols;
+		std::map<Symbol, std::unique_ptr<Namespace>> children;
+		std::vector<std::shared_ptr<const Namespace>> imports;
+		std::set<Symbol> use;
+		Provider provider;
+		mutable std::unique_ptr<const std::set<Symbol>> flat;
+
+	};
+
+	/**
+	 * A stack frame. Named frames refer to a Namespace in the enclosing
+	 * frame's tree; anonymous frames own a Namespace that dies with them.
+	 */
 	struct Scope {
 
-		Scope(const std::string& name = "") : name(name), use{""} {}
+		Scope(Namespace* space) : space(space) {}
+		Scope(std::unique_ptr<Namespace>&& local)
+			: space(local.get()), local(std::move(local)) {}
+
+		Namespace* space;
+		std::unique_ptr<Namespace> local;
+
+	};
+
+	/**
+	 * An entry in the undo log: enough to reverse one change to a Namespace
+	 * that existed when the latest snapshot was taken.
+	 */
+	struct Change {
+
+		enum Type {
+			DEFINE,
+			CHILD,
+			IMPORT,
+			PROVIDE,
+			USE,
+		};
+
+		Change(Type type, Namespace* space, Symbol name = Symbol(),
+			Symbol canonical = Symbol(), Reference<const Expression> previous
+			= Reference<const Expression>(), Provider provider = Provider())
+			: type(type), space(space), name(name), canonical(canonical),
+			previous(previous), provider(provider) {}
+
+		Type type;
+		Namespace* space;
+		Symbol name;
+		Symbol canonical;
+		Reference<const Expression> previous;
+		Provider provider;
+
+	};
 
-		std::string name;
-		std::map<Signature, std::shared_ptr<const Expression>> symbols;
-		std::set<std::string> use;
+	/**
+	 * The state recorded by a snapshot; everything else is in the undo log.
+	 */
+	struct Mark {
+
+		Snapshot id;
+		std::size_t changes;
+		std::size_t head_size;
+		std::vector<Namespace*> frames;
 
 	};
 
+	Namespace* open(Namespace&, Symbol);
+	void link(Namespace&, const std::shared_ptr<const Namespace>&);
+	void link_child(Namespace&, const std::shared_ptr<const Namespace>&);
+	void insert(Namespace&, const Signature&,
+		Reference<const Expression>, bool);
+	bool recording(const Namespace& space) const {
+		return !marks.empty() && space.generation < generation;
+	}
+
+	void read_namespace(Image&, Namespace&);
+	static void write_namespace(Image&, const std::vector<const Namespace*>&);
+	static const Signature* find(const Namespace&, const Signature&);
+	static void resolve(const Namespace&, Symbol,
+		std::vector<const Namespace*>&);
+
+	unsigned int generation;
+	std::shared_ptr<Namespace> global;
 	std::list<Scope> stack;
+	std::vector<const Namespace*> candidates;
+	std::vector<Change> changes;
+	std::vector<Mark> marks;
+	std::map<std::string, std::shared_ptr<const Mapping>> files;
 
 
 };
 
 
 #endif
-
@@ -1,4 +1,5 @@
 #include "Data.h"
+#include "Image.h"
 #include "List.h"
 #include <iomanip>
 #include <limits>
@@ -15,10 +16,10 @@ Data::~Data() {}
 /**
  * A numeric Value as a List is, go figure, a List of only that Value.
  */
-std::shared_ptr<const List> Data::evaluate(Context&) const {
-	std::shared_ptr<List> result(new List(line_number, column_number));
+Reference<const List> Data::evaluate(Context&) const {
+	Reference<List> result(new List(line_number, column_number));
 	result->add(self_reference());
-	return std::static_pointer_cast<const List>(result);
+	return static_reference_cast<const List>(result);
 }
 
 
@@ -36,4 +37,13 @@ std::string Data::get_content() const {
 double Data::get_data() const { return value; }
 
 
+
+void Data::write(Image& image) const {
+	image.write_tag(Image::DATA);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_number(value);
+}
+
+
 Data* Data::clone() const { return new Data(*this); }
@@ -15,9 +15,10 @@ public:
 	Data(int, int, double);
 	virtual ~Data();
 
-	virtual std::shared_ptr<const List> evaluate(Context&) const;
+	virtual Reference<const List> evaluate(Context&) const;
 	virtual std::string get_content() const;
 	virtual double get_data() const;
+	virtual void write(Image&) const;
 
 protected:
 
@@ -0,0 +1,114 @@
+#include "Dictionary.h"
+#include "Content.h"
+#include "Image.h"
+#include "List.h"
+#include <cstring>
+#include <stdexcept>
+
+
+Dictionary::Dictionary(int line, int column) : Value(line, column) {}
+
+
+Dictionary::~Dictionary() {}
+
+
+/**
+ * Set the Value of a key. A key keeps its original place in the order of
+ * keys even if it's set again.
+ */
+void Dictionary::set(Symbol key, Reference<const Value> value) {
+	auto position = values.find(key);
+	if (position == values.end()) {
+		values.insert({key, value});
+		order.push_back(key);
+	} else {
+		position->second = value;
+	}
+}
+
+
+/**
+ * Look up a key, giving a null Reference if it's not there.
+ */
+Reference<const Value> Dictionary::get(const std::string& name) const {
+	Symbol key;
+	if (!Symbol::find(name, key))
+		return Reference<const Value>();
+	auto position = values.find(key);
+	return position == values.end() ? Reference<const Value>()
+		: position->second;
+}
+
+
+/**
+ * A Dictionary as a List is a List of just that Dictionary, so that it can
+ * be passed around like any other Value.
+ */
+Reference<const List> Dictionary::evaluate(Context&) const {
+	Reference<List> result(new List(line_number, column_number));
+	result->add(self_reference());
+	return static_reference_cast<const List>(result);
+}
+
+
+std::string Dictionary::get_content() const {
+	throw std::runtime_error("Attempt to use dictionary as content.");
+}
+
+
+double Dictionary::get_data() const {
+	throw std::runtime_error("Attempt to use dictionary as data.");
+}
+
+
+
+void Dictionary::write(Image& image) const {
+	image.write_tag(Image::DICTIONARY);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_integer(order.size());
+	for (auto i = order.begin(); i != order.end(); ++i) {
+		image.write_symbol(*i);
+		image.write_expression(values.find(*i)->second);
+	}
+}
+
+
+/**
+ * Build a Dictionary from tab-separated text, one entry per line, with the
+ * key before the first tab and the value after it. Blank lines are skipped,
+ * and a line with no tab has an empty value.
+ */
+Reference<const Dictionary> Dictionary::parse(int line, int column,
+	const char* data, std::size_t size) {
+
+	Reference<Dictionary> result(new Dictionary(line, column));
+	const char* const end = data + size;
+
+	while (data != end) {
+
+		const char* newline = static_cast<const char*>
+			(std::memchr(data, '\n', end - data));
+		if (!newline) newline = end;
+		const char* last = newline;
+		if (last != data && last[-1] == '\r') --last;
+
+		if (last != data) {
+			const char* tab = static_cast<const char*>
+				(std::memchr(data, '\t', last - data));
+			const char* value = tab ? tab + 1 : last;
+			result->set(std::string(data, tab ? tab : last),
+				Reference<const Value>(new Content(line, column,
+				std::string(value, last))));
+		}
+
+		data = newline == end ? end : newline + 1;
+
+	}
+
+	return static_reference_cast<const Dictionary>(result);
+
+}
+
+
+Dictionary* Dictionary::clone() const { return new Dictionary(*this); }
@@ -0,0 +1,47 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+#include "Reference.h"
+#include "Symbol.h"
+#include "Value.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * A Value mapping names to Values, with constant-time lookup. Keys are
+ * interned, so a lookup hashes a single integer; and since a name that was
+ * never interned can't be a key, looking one up doesn't intern it.
+ */
+class Dictionary : public Value {
+public:
+
+	Dictionary(int, int);
+	virtual ~Dictionary();
+
+	void set(Symbol, Reference<const Value>);
+	Reference<const Value> get(const std::string&) const;
+	const std::vector<Symbol>& keys() const { return order; }
+
+	virtual Reference<const List> evaluate(Context&) const;
+	virtual std::string get_content() const;
+	virtual double get_data() const;
+	virtual void write(Image&) const;
+
+	static Reference<const Dictionary> parse(int, int, const char*,
+		std::size_t);
+
+protected:
+
+	virtual Dictionary* clone() const;
+
+private:
+
+	std::unordered_map<Symbol, Reference<const Value>> values;
+	std::vector<Symbol> order;
+
+};
+
+
+#endif
@@ -0,0 +1,209 @@
+#include "Escape.h"
+#include <cstddef>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+	const char hex_digits[] = "0123456789ABCDEF";
+
+	/**
+	 * What needs escaping, and how, for each kind of escaping. Each rule says
+	 * whether a byte is special, and, where the hardware allows, which of
+	 * sixteen bytes are, as a bit mask.
+	 */
+
+	struct Html {
+#ifdef __SSE2__
+		static int special(__m128i chunk) {
+			const __m128i result = _mm_or_si128(_mm_or_si128
+				(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('&')),
+				_mm_cmpeq_epi8(chunk, _mm_set1_epi8('<'))), _mm_or_si128
+				(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('>')),
+				_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'))),
+				_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\''))));
+			return _mm_movemask_epi8(result);
+		}
+#endif
+		static bool special(unsigned char c) {
+			return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+		}
+		static void escape(unsigned char c, std::string& result) {
+			switch (c) {
+			case '&': result += "&amp;"; break;
+			case '<': result += "&lt;"; break;
+			case '>': result += "&gt;"; break;
+			case '"': result += "&quot;"; break;
+			default: result += "&#39;"; break;
+			}
+		}
+	};
+
+	/**
+	 * Everything but the unreserved characters of RFC 3986 is percent-encoded,
+	 * so that the result is safe anywhere in a URL, even as a query value.
+	 */
+	struct Url {
+#ifdef __SSE2__
+		static int special(__m128i chunk) {
+			const __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+			const __m128i letter = _mm_and_si128
+				(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+				_mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+			const __m128i digit = _mm_and_si128
+				(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+				_mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+			const __m128i mark = _mm_or_si128(_mm_or_si128
+				(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('-')),
+				_mm_cmpeq_epi8(chunk, _mm_set1_epi8('.'))), _mm_or_si128
+				(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')),
+				_mm_cmpeq_epi8(chunk, _mm_set1_epi8('~'))));
+			return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter,
+				digit), mark)) & 0xffff;
+		}
+#endif
+		static bool special(unsigned char c) {
+			return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+				|| (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_'
+				|| c == '~');
+		}
+		static void escape(unsigned char c, std::string& result) {
+			result += '%';
+			result += hex_digits[c >> 4];
+			result += hex_digits[c & 0xf];
+		}
+	};
+
+	/**
+	 * Quotes, backslashes, and control characters. Anything else, including
+	 * UTF-8, can go in a JSON string as it is.
+	 */
+	struct Json {
+#ifdef __SSE2__
+		static int special(__m128i chunk) {
+			const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk,
+				_mm_set1_epi8(0x1f)), chunk);
+			return _mm_movemask_epi8(_mm_or_si128(control, _mm_or_si128
+				(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+				_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')))));
+		}
+#endif
+		static bool special(unsigned char c) {
+			return c < 0x20 || c == '"' || c == '\\';
+		}
+		static void escape(unsigned char c, std::string& result) {
+			switch (c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\b': result += "\\b"; break;
+			case '\f': result += "\\f"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				result += "\\u00";
+				result += hex_digits[c >> 4];
+				result += hex_digits[c & 0xf];
+				break;
+			}
+		}
+	};
+
+	/**
+	 * Inside single quotes, only a single quote is special, and it has to be
+	 * written by closing the quotes, escaping it, and opening them again.
+	 */
+	struct Shell {
+#ifdef __SSE2__
+		static int special(__m128i chunk) {
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(chunk,
+				_mm_set1_epi8('\'')));
+		}
+#endif
+		static bool special(unsigned char c) {
+			return c == '\'';
+		}
+		static void escape(unsigned char, std::string& result) {
+			result += "'\\''";
+		}
+	};
+
+	/**
+	 * The length of the run of bytes from the start that need no escaping.
+	 */
+	template<class Rule>
+	std::size_t plain_run(const char* data, std::size_t size) {
+		std::size_t i = 0;
+#ifdef __SSE2__
+		for (; i + 16 <= size; i += 16) {
+			const int mask = Rule::special(_mm_loadu_si128
+				(reinterpret_cast<const __m128i*>(data + i)));
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+#endif
+		for (; i < size; ++i)
+			if (Rule::special(static_cast<unsigned char>(data[i])))
+				return i;
+		return size;
+	}
+
+	template<class Rule>
+	void escape(const char* data, std::size_t size, std::string& result) {
+		std::size_t i = 0;
+		while (true) {
+			const std::size_t run = plain_run<Rule>(data + i, size - i);
+			result.append(data + i, run);
+			i += run;
+			if (i == size) break;
+			Rule::escape(static_cast<unsigned char>(data[i++]), result);
+		}
+	}
+
+	/**
+	 * Escape some text, handing it back as it is if nothing in it needs
+	 * escaping.
+	 */
+	template<class Rule>
+	std::string escape(const std::string& text) {
+		const std::size_t run = plain_run<Rule>(text.data(), text.size());
+		if (run == text.size()) return text;
+		std::string result;
+		result.reserve(text.size() + text.size() / 8 + 16);
+		result.append(text, 0, run);
+		escape<Rule>(text.data() + run, text.size() - run, result);
+		return result;
+	}
+
+}
+
+
+std::string escape_html(const std::string& text) {
+	return escape<Html>(text);
+}
+
+
+std::string escape_url(const std::string& text) {
+	return escape<Url>(text);
+}
+
+
+std::string escape_json(const std::string& text) {
+	return escape<Json>(text);
+}
+
+
+/**
+ * Quote text as a single shell word, which, unlike the others, always changes
+ * it: even the empty string needs quotes to be a word at all.
+ */
+std::string escape_shell(const std::string& text) {
+	std::string result;
+	result.reserve(text.size() + 2);
+	result += '\'';
+	escape<Shell>(text.data(), text.size(), result);
+	result += '\'';
+	return result;
+}
@@ -0,0 +1,19 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+#include <string>
+
+
+/**
+ * Escaping for the places that text ends up: HTML text and attributes, URL
+ * components, the inside of JSON strings, and shell words. Runs of text that
+ * need no escaping, which is usually nearly all of it, are found sixteen bytes
+ * at a time where the hardware allows and copied in one go.
+ */
+
+std::string escape_html(const std::string&);
+std::string escape_url(const std::string&);
+std::string escape_json(const std::string&);
+std::string escape_shell(const std::string&);
+
+
+#endif
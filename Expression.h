@@ -1,18 +1,20 @@
 #ifndef EXPRESSION_H
 #define EXPRESSION_H
-#include <memory>
+#include "Reference.h"
 #include <string>
 
 
 class Context;
+class Image;
 class List;
 class Value;
 
 
 /**
- * An expression that can be evaluated to produce a Value.
+ * An expression that can be evaluated to produce a Value. Expressions count
+ * their own References, and are shared freely between trees and Contexts.
  */
-class Expression {
+class Expression : public Counted {
 public:
 
 	Expression(int line, int column) : line_number(line),
@@ -20,9 +22,10 @@ public:
 
 	virtual ~Expression() {}
 
-	virtual std::shared_ptr<const List> evaluate(Context&) const = 0;
+	virtual Reference<const List> evaluate(Context&) const = 0;
 	virtual std::string get_content() const = 0;
 	virtual double get_data() const = 0;
+	virtual void write(Image&) const = 0;
 
 	const int line_number;
 	const int column_number;
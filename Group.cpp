@@ -1,5 +1,6 @@
 #include "Group.h"
 #include "Content.h"
+#include "Image.h"
 #include "List.h"
 #include <sstream>
 #include <stdexcept>
@@ -9,7 +10,7 @@ Group::Group(int line, int column) : Value(line, column) {}
 
 
 Group::Group(int line, int column,
-	const std::vector<std::shared_ptr<const Expression>>& value) :
+	const std::vector<Reference<const Expression>>& value) :
 	Value(line, column), value(value) {}
 
 
@@ -19,7 +20,7 @@ Group::~Group() {}
 /**
  * Add an Expression to the Group.
  */
-void Group::add(std::shared_ptr<const Expression> expression) {
+void Group::add(Reference<const Expression> expression) {
 	value.push_back(expression);
 }
 
@@ -27,16 +28,16 @@ void Group::add(std::shared_ptr<const Expression> expression) {
 /**
  * Evaluate each Expression in the Group and return a List of results.
  */
-std::shared_ptr<const List> Group::evaluate(Context& context) const {
+Reference<const List> Group::evaluate(Context& context) const {
 
 	std::ostringstream result;
 	for (auto i = value.begin(); i != value.end(); ++i)
 		result << (*i)->evaluate(context)->get_content();
 
-	std::shared_ptr<const Value> content(new Content
+	Reference<const Value> content(new Content
 		(line_number, column_number, result.str()));
-	std::vector<std::shared_ptr<const Value>> vector(1, content);
-	std::shared_ptr<const List> list(new List
+	std::vector<Reference<const Value>> vector(1, content);
+	Reference<const List> list(new List
 		(line_number, column_number, vector));
 
 	return list;
@@ -56,4 +57,13 @@ double Group::get_data() const {
 }
 
 
+
+void Group::write(Image& image) const {
+	image.write_tag(Image::GROUP);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_expressions(value);
+}
+
+
 Group* Group::clone() const { return new Group(*this); }
@@ -1,7 +1,7 @@
 #ifndef GROUP_H
 #define GROUP_H
+#include "Reference.h"
 #include "Value.h"
-#include <memory>
 #include <vector>
 
 
@@ -12,13 +12,14 @@ class Group : public Value {
 public:
 
 	Group(int, int);
-	Group(int, int, const std::vector<std::shared_ptr<const Expression>>&);
+	Group(int, int, const std::vector<Reference<const Expression>>&);
 	virtual ~Group();
 
-	void add(std::shared_ptr<const Expression>);
-	virtual std::shared_ptr<const List> evaluate(Context&) const;
+	void add(Reference<const Expression>);
+	virtual Reference<const List> evaluate(Context&) const;
 	virtual std::string get_content() const;
 	virtual double get_data() const;
+	virtual void write(Image&) const;
 
 protected:
 
@@ -26,7 +27,7 @@ protected:
 
 private:
 
-	std::vector<std::shared_ptr<const Expression>> value;
+	std::vector<Reference<const Expression>> value;
 
 };
 
@@ -1,11 +1,13 @@
 #include "Identifier.h"
 #include "Context.h"
+#include "Image.h"
+#include "List.h"
 #include <stdexcept>
 
 #include <iostream>
 
 
-Identifier::Identifier(int line, int column, const std::string& value) :
+Identifier::Identifier(int line, int column, Symbol value) :
 	Value(line, column), value(value) {}
 
 
@@ -15,7 +17,7 @@ Identifier::~Identifier() {}
 /**
  * A name derives its meaning from a Context.
  */
-std::shared_ptr<const List> Identifier::evaluate(Context& context) const {
+Reference<const List> Identifier::evaluate(Context& context) const {
 	return context.evaluate(value);
 }
 
@@ -36,4 +38,13 @@ double Identifier::get_data() const {
 }
 
 
+
+void Identifier::write(Image& image) const {
+	image.write_tag(Image::IDENTIFIER);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_symbol(value);
+}
+
+
 Identifier* Identifier::clone() const { return new Identifier(*this); }
@@ -1,23 +1,26 @@
 #ifndef IDENTIFIER_H
 #define IDENTIFIER_H
+#include "Symbol.h"
 #include "Value.h"
 #include <string>
 
 
 /**
- * A bare identifier, exactly as read from a source file.
+ * A bare identifier, exactly as read from a source file, interned once when
+ * the Parser creates it.
  */
 class Identifier : public Value {
 public:
 
-	Identifier(int, int, const std::string&);
+	Identifier(int, int, Symbol);
 	virtual ~Identifier();
 
-	virtual std::shared_ptr<const List> evaluate(Context&) const;
+	virtual Reference<const List> evaluate(Context&) const;
 	virtual std::string get_content() const;
 	virtual double get_data() const;
+	virtual void write(Image&) const;
 
-	std::string value;
+	Symbol value;
 
 protected:
 
@@ -0,0 +1,389 @@
+#include "Image.h"
+#include "Block.h"
+#include "Builder.h"
+#include "Compound.h"
+#include "Content.h"
+#include "Context.h"
+#include "Data.h"
+#include "Dictionary.h"
+#include "Group.h"
+#include "Identifier.h"
+#include "List.h"
+#include "Mapping.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+	/**
+	 * The last byte is the version of the format. An image of any other
+	 * version is just stale, and gets rebuilt.
+	 */
+	const char magic[8] = {'V', 'I', 'S', 'I', 'O', 'N', 0, 2};
+
+	/**
+	 * Write the size and modification time of a source file, or fail loudly.
+	 */
+	void write_source(Image& image, const std::string& path) {
+		struct stat status;
+		if (stat(path.c_str(), &status) != 0) {
+			std::ostringstream message;
+			message << "Unable to find image source \"" << path << "\".";
+			throw std::runtime_error(message.str());
+		}
+		image.write_string(path);
+		image.write_integer(status.st_size);
+		image.write_integer(status.st_mtim.tv_sec);
+		image.write_integer(status.st_mtim.tv_nsec);
+	}
+
+	/**
+	 * Test whether a source file is still the size and age it was.
+	 */
+	bool read_source(Image& image) {
+		const std::string path = image.read_string();
+		const int64_t size = image.read_integer();
+		const int64_t seconds = image.read_integer();
+		const int64_t nanoseconds = image.read_integer();
+		struct stat status;
+		return stat(path.c_str(), &status) == 0
+			&& status.st_size == size
+			&& status.st_mtim.tv_sec == seconds
+			&& status.st_mtim.tv_nsec == nanoseconds;
+	}
+
+}
+
+
+Image::Image() : current(nullptr), end(nullptr) {}
+
+
+Image::Image(const char* begin, const char* end) : current(begin),
+	end(end) {}
+
+
+/**
+ * Load an image into a Context. If the image doesn't exist, is damaged, or is
+ * stale, leave the Context alone and say so, so that the caller can rebuild
+ * it the slow way.
+ */
+bool Image::load(const std::string& path, Context& context) try {
+
+	const std::shared_ptr<const Mapping> file = Mapping::open(path);
+	if (!file || file->size() < sizeof(magic))
+		return false;
+
+	const char* const begin = file->data();
+	if (std::memcmp(begin, magic, sizeof(magic)) != 0)
+		return false;
+
+	Image image(begin + sizeof(magic), begin + file->size());
+
+	if (image.read_integer() != context.tab_size
+		|| image.read_integer() != context.indent_mode)
+		return false;
+
+	for (int64_t sources = image.read_integer(); sources > 0; --sources)
+		if (!read_source(image))
+			return false;
+
+	for (int64_t symbols = image.read_integer(); symbols > 0; --symbols)
+		image.symbols.push_back(image.read_string());
+
+	// A damaged image can fail partway through, so read it into a snapshot.
+	const Context::Snapshot snapshot = context.snapshot();
+	try {
+		context.read(image);
+	} catch (const std::runtime_error&) {
+		context.restore(snapshot);
+		context.release(snapshot);
+		throw;
+	}
+	context.release(snapshot);
+	return true;
+
+} catch (const std::runtime_error&) {
+
+	return false;
+
+}
+
+
+/**
+ * Save a Context as an image. The image is written to a temporary file and
+ * renamed into place, so that concurrent readers only ever see either the old
+ * image or the new one.
+ */
+void Image::save(const std::string& path, const Context& context) {
+
+	Image body;
+	context.write(body);
+
+	Image header;
+	header.buffer.assign(magic, sizeof(magic));
+	header.write_integer(context.tab_size);
+	header.write_integer(context.indent_mode);
+	header.write_integer(context.sources.size());
+	for (auto i = context.sources.begin(); i != context.sources.end(); ++i)
+		write_source(header, *i);
+	header.write_integer(body.symbols.size());
+	for (auto i = body.symbols.begin(); i != body.symbols.end(); ++i)
+		header.write_string(i->string());
+
+	std::ostringstream temporary;
+	temporary << path << '.' << getpid();
+
+	FILE* file = std::fopen(temporary.str().c_str(), "wb");
+	if (!file) {
+		std::ostringstream message;
+		message << "Unable to write image \"" << path << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+	const bool written =
+		std::fwrite(header.buffer.data(), 1, header.buffer.size(), file)
+			== header.buffer.size() &&
+		std::fwrite(body.buffer.data(), 1, body.buffer.size(), file)
+			== body.buffer.size();
+
+	if (std::fclose(file) != 0 || !written
+		|| std::rename(temporary.str().c_str(), path.c_str()) != 0) {
+		std::remove(temporary.str().c_str());
+		std::ostringstream message;
+		message << "Unable to write image \"" << path << "\".";
+		throw std::runtime_error(message.str());
+	}
+
+}
+
+
+void Image::write_tag(Tag tag) { buffer += char(tag); }
+
+
+/**
+ * Integers are written as zigzag-encoded variable-length quantities, since
+ * most of them are small counts.
+ */
+void Image::write_integer(int64_t value) {
+	uint64_t bits = (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+	while (bits >= 0x80) {
+		buffer += char(bits | 0x80);
+		bits >>= 7;
+	}
+	buffer += char(bits);
+}
+
+
+void Image::write_number(double value) {
+	char bytes[sizeof(value)];
+	std::memcpy(bytes, &value, sizeof(value));
+	buffer.append(bytes, sizeof(bytes));
+}
+
+
+void Image::write_string(const std::string& value) {
+	write_integer(value.size());
+	buffer += value;
+}
+
+
+/**
+ * Symbols are written once each, in a table at the start of the image, and
+ * referred to by their position in it.
+ */
+void Image::write_symbol(Symbol symbol) {
+	auto position = symbol_ids.find(symbol);
+	if (position == symbol_ids.end()) {
+		position = symbol_ids.insert({symbol, symbols.size()}).first;
+		symbols.push_back(symbol);
+	}
+	write_integer(position->second);
+}
+
+
+/**
+ * Expressions shared between several definitions are written once, and the
+ * rest of the time referred to by the order in which they were finished.
+ */
+void Image::write_expression(const Reference<const Expression>& expression) {
+	auto position = expression_ids.find(expression.get());
+	if (position != expression_ids.end()) {
+		write_tag(REPEAT);
+		write_integer(position->second);
+		return;
+	}
+	expression->write(*this);
+	expression_ids.insert({expression.get(), expression_ids.size()});
+}
+
+
+void Image::write_expressions
+	(const std::vector<Reference<const Expression>>& expressions) {
+	write_integer(expressions.size());
+	for (auto i = expressions.begin(); i != expressions.end(); ++i)
+		write_expression(*i);
+}
+
+
+int64_t Image::read_integer() {
+	uint64_t bits = 0;
+	for (int shift = 0; ; shift += 7) {
+		if (current == end || shift > 63)
+			throw std::runtime_error("Truncated image.");
+		const uint8_t byte = *current++;
+		bits |= uint64_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) break;
+	}
+	return int64_t(bits >> 1) ^ -int64_t(bits & 1);
+}
+
+
+double Image::read_number() {
+	if (end - current < int64_t(sizeof(double)))
+		throw std::runtime_error("Truncated image.");
+	double value;
+	std::memcpy(&value, current, sizeof(value));
+	current += sizeof(value);
+	return value;
+}
+
+
+std::string Image::read_string() {
+	const int64_t size = read_integer();
+	if (size < 0 || end - current < size)
+		throw std::runtime_error("Truncated image.");
+	std::string value(current, size);
+	current += size;
+	return value;
+}
+
+
+Symbol Image::read_symbol() {
+	const int64_t id = read_integer();
+	if (id < 0 || id >= int64_t(symbols.size()))
+		throw std::runtime_error("Invalid symbol in image.");
+	return symbols[id];
+}
+
+
+/**
+ * Rebuild an Expression, using the same public interface as the Parser.
+ */
+Reference<const Expression> Image::read_expression() {
+
+	if (current == end)
+		throw std::runtime_error("Truncated image.");
+
+	const Tag tag = Tag(*current++);
+
+	if (tag == REPEAT) {
+		const int64_t id = read_integer();
+		if (id < 0 || id >= int64_t(expressions.size()))
+			throw std::runtime_error("Invalid expression in image.");
+		return expressions[id];
+	}
+
+	const int line = read_integer();
+	const int column = read_integer();
+	Reference<const Expression> result;
+
+	switch (tag) {
+
+	case BLOCK:
+		result.reset(new Block(line, column, read_expressions()));
+		break;
+
+	case BUILDER:
+		result.reset(new Builder(line, column, read_string()));
+		break;
+
+	case COMPOUND:
+		{
+			Reference<Compound> compound(new Compound(line, column));
+			compound->set_determiner(read_expression());
+			compound->set_identifier(read_symbol());
+			for (int64_t i = read_integer(); i > 0; --i) {
+				compound->add_data();
+				for (int64_t j = read_integer(); j > 0; --j)
+					compound->add_data(read_expression());
+			}
+			for (int64_t i = read_integer(); i > 0; --i) {
+				compound->add_content();
+				for (int64_t j = read_integer(); j > 0; --j)
+					compound->add_content(read_expression());
+			}
+			result = compound;
+		}
+		break;
+
+	case CONTENT:
+		result.reset(new Content(line, column, read_string()));
+		break;
+
+	case DATA:
+		result.reset(new Data(line, column, read_number()));
+		break;
+
+	case DICTIONARY:
+		{
+			Reference<Dictionary> dictionary(new Dictionary(line, column));
+			for (int64_t i = read_integer(); i > 0; --i) {
+				const Symbol key = read_symbol();
+				dictionary->set(key, read_value());
+			}
+			result = dictionary;
+		}
+		break;
+
+	case GROUP:
+		result.reset(new Group(line, column, read_expressions()));
+		break;
+
+	case IDENTIFIER:
+		result.reset(new Identifier(line, column, read_symbol()));
+		break;
+
+	case LIST:
+		{
+			Reference<List> list(new List(line, column));
+			for (int64_t i = read_integer(); i > 0; --i)
+				list->add(read_value());
+			result = list;
+		}
+		break;
+
+	default:
+		throw std::runtime_error("Invalid expression in image.");
+
+	}
+
+	expressions.push_back(result);
+	return result;
+
+}
+
+
+/**
+ * Read an expression that has to be a Value, as the elements of Lists and
+ * Dictionaries are. A damaged image might say otherwise.
+ */
+Reference<const Value> Image::read_value() {
+	const Reference<const Value> result =
+		dynamic_reference_cast<const Value>(read_expression());
+	if (!result)
+		throw std::runtime_error("Invalid expression in image.");
+	return result;
+}
+
+
+std::vector<Reference<const Expression>> Image::read_expressions() {
+	std::vector<Reference<const Expression>> result;
+	for (int64_t i = read_integer(); i > 0; --i)
+		result.push_back(read_expression());
+	return result;
+}
@@ -0,0 +1,79 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#include "Reference.h"
+#include "Symbol.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+class Context;
+class Expression;
+class Value;
+
+
+/**
+ * A startup image: the global symbol table and header buffer of a fully
+ * initialized Context, written to a file so that a later run can map it and
+ * carry on without scanning, parsing, or evaluating the code that built it.
+ *
+ * Everything in an image is addressed by position in the file, never by
+ * pointer. The image records the size and modification time of every source
+ * file that contributed to it, along with the options that affect scanning,
+ * and is considered stale if any of them differ.
+ */
+class Image {
+public:
+
+	static bool load(const std::string&, Context&);
+	static void save(const std::string&, const Context&);
+
+	enum Tag {
+		REPEAT = 0,
+		BLOCK,
+		COMPOUND,
+		CONTENT,
+		DATA,
+		GROUP,
+		IDENTIFIER,
+		LIST,
+		DICTIONARY,
+		BUILDER,
+	};
+
+	void write_tag(Tag);
+	void write_integer(int64_t);
+	void write_number(double);
+	void write_string(const std::string&);
+	void write_symbol(Symbol);
+	void write_expression(const Reference<const Expression>&);
+	void write_expressions(const std::vector<Reference<const Expression>>&);
+
+	int64_t read_integer();
+	double read_number();
+	std::string read_string();
+	Symbol read_symbol();
+	Reference<const Expression> read_expression();
+	std::vector<Reference<const Expression>> read_expressions();
+
+private:
+
+	Image();
+	Image(const char*, const char*);
+
+	Reference<const Value> read_value();
+
+	std::string buffer;
+	std::map<Symbol, int64_t> symbol_ids;
+	std::vector<Symbol> symbols;
+	std::map<const Expression*, int64_t> expression_ids;
+	std::vector<Reference<const Expression>> expressions;
+
+	const char* current;
+	const char* end;
+
+};
+
+
+#endif
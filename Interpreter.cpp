@@ -15,11 +15,25 @@ Interpreter::Interpreter(const Parser& parser, std::ostream& stream) :
  * flattening the resulting results to the stream. Of results.
  */
 void Interpreter::run() {
+	render(*parse(), stream);
+}
+
+
+Reference<const Expression> Interpreter::parse() {
+	return parser.run(context);
+}
+
+
+/**
+ * Evaluate an Expression that has already been parsed, sending the result to
+ * some stream, so that one template can be rendered over and over.
+ */
+void Interpreter::render(const Expression& expression,
+	std::ostream& output) {
 
-	std::shared_ptr<const Expression> expression = parser.run(context);
-	auto result = expression->evaluate(context);
-	stream << context.head_buffer.str() << '\n';
- 	if (!context.head_mode)
-		stream << result->get_content();
+	auto result = expression.evaluate(context);
+	output << context.head_buffer.str() << '\n';
+	if (!context.head_mode)
+		result->write_content(output);
 
 }
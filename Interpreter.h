@@ -4,6 +4,7 @@
 #include "Context.h"
 
 
+class Expression;
 class Parser;
 
 
@@ -16,6 +17,9 @@ public:
 	Interpreter(const Parser&, std::ostream&);
 	void run();
 
+	Reference<const Expression> parse();
+	void render(const Expression&, std::ostream&);
+
 	Context context;
 
 private:
@@ -0,0 +1,509 @@
+#include "Json.h"
+#include "Content.h"
+#include "Context.h"
+#include "Data.h"
+#include "Dictionary.h"
+#include "List.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+	/**
+	 * Values nested deeper than this are refused, rather than overflowing
+	 * the stack of the recursive descent.
+	 */
+	const int depth_limit = 512;
+
+	int hex_value(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 0xa;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 0xa;
+		return -1;
+	}
+
+	void encode(long point, std::string& result) {
+		if (point < 0x80) {
+			result += char(point);
+		} else if (point < 0x800) {
+			result += char(0xc0 | point >> 6);
+			result += char(0x80 | (point & 0x3f));
+		} else if (point < 0x10000) {
+			result += char(0xe0 | point >> 12);
+			result += char(0x80 | (point >> 6 & 0x3f));
+			result += char(0x80 | (point & 0x3f));
+		} else {
+			result += char(0xf0 | point >> 18);
+			result += char(0x80 | (point >> 12 & 0x3f));
+			result += char(0x80 | (point >> 6 & 0x3f));
+			result += char(0x80 | (point & 0x3f));
+		}
+	}
+
+	/**
+	 * A position in a JSON document, which can either be checked and skipped
+	 * over, or decoded. Only text that has been checked is ever decoded, so
+	 * decoding takes its well-formedness for granted.
+	 */
+	class Reader {
+	public:
+
+		Reader(const std::string& text, std::size_t position,
+			Json::Escape escape = nullptr) : position(position),
+			data(text.c_str()), size(text.size()), escape(escape) {}
+
+		void skip_value(int = 0);
+		Reference<const Value> value(int, int);
+		std::string string();
+
+		void space() {
+			while (position < size && (data[position] == ' '
+				|| data[position] == '\n' || data[position] == '\r'
+				|| data[position] == '\t'))
+				++position;
+		}
+
+		bool next(char c) {
+			space();
+			if (position == size || data[position] != c) return false;
+			++position;
+			return true;
+		}
+
+		void expect(char c) {
+			if (!next(c))
+				fail(std::string("expected \"") + c + "\"");
+		}
+
+		char peek() const { return position < size ? data[position] : 0; }
+
+		[[noreturn]] void fail(const std::string&) const;
+
+		std::size_t position;
+
+	private:
+
+		void skip_string();
+		void skip_number();
+		void skip_word(const char*);
+		std::size_t plain_run() const;
+
+		const char* data;
+		std::size_t size;
+		Json::Escape escape;
+
+	};
+
+	void Reader::fail(const std::string& reason) const {
+		int line = 1;
+		std::size_t start = 0;
+		for (std::size_t i = 0; i < position && i < size; ++i) {
+			if (data[i] == '\n') {
+				++line;
+				start = i + 1;
+			}
+		}
+		std::ostringstream message;
+		message << "Invalid JSON at line " << line << ", column "
+			<< position - start + 1 << ": " << reason << ".";
+		throw std::runtime_error(message.str());
+	}
+
+	/**
+	 * The length of the run of string characters from here that are just
+	 * themselves: anything but quotes, backslashes, and control characters,
+	 * found sixteen at a time where the hardware allows.
+	 */
+	std::size_t Reader::plain_run() const {
+		const char* start = data + position;
+		const std::size_t length = size - position;
+		std::size_t i = 0;
+#ifdef __SSE2__
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i control = _mm_set1_epi8(0x1f);
+		for (; i + 16 <= length; i += 16) {
+			const __m128i chunk = _mm_loadu_si128
+				(reinterpret_cast<const __m128i*>(start + i));
+			const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128
+				(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk,
+				backslash)), _mm_cmpeq_epi8(_mm_min_epu8(chunk, control),
+				chunk)));
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+#endif
+		for (; i < length; ++i) {
+			const unsigned char c = start[i];
+			if (c == '"' || c == '\\' || c < 0x20)
+				return i;
+		}
+		return length;
+	}
+
+	void Reader::skip_value(int depth) {
+
+		if (depth > depth_limit)
+			fail("values are nested too deeply");
+
+		space();
+		switch (peek()) {
+
+		case '{':
+			++position;
+			if (next('}')) return;
+			do {
+				space();
+				if (peek() != '"') fail("expected a string");
+				skip_string();
+				expect(':');
+				skip_value(depth + 1);
+			} while (next(','));
+			expect('}');
+			return;
+
+		case '[':
+			++position;
+			if (next(']')) return;
+			do {
+				skip_value(depth + 1);
+			} while (next(','));
+			expect(']');
+			return;
+
+		case '"':
+			skip_string();
+			return;
+
+		case 't':
+			skip_word("true");
+			return;
+
+		case 'f':
+			skip_word("false");
+			return;
+
+		case 'n':
+			skip_word("null");
+			return;
+
+		default:
+			skip_number();
+			return;
+
+		}
+
+	}
+
+	void Reader::skip_string() {
+		++position;
+		while (true) {
+			position += plain_run();
+			if (position == size) fail("unterminated string");
+			const char c = data[position];
+			if (c == '"') {
+				++position;
+				return;
+			}
+			if (c != '\\') fail("control character in string");
+			++position;
+			const char escaped = peek();
+			if (escaped == 'u') {
+				for (int i = 1; i <= 4; ++i)
+					if (position + i >= size
+						|| hex_value(data[position + i]) == -1)
+						fail("invalid escape");
+				position += 5;
+			} else if (escaped && std::strchr("\"\\/bfnrt", escaped)) {
+				++position;
+			} else {
+				fail("invalid escape");
+			}
+		}
+	}
+
+	void Reader::skip_number() {
+		const auto digits = [this]() {
+			if (peek() < '0' || peek() > '9') fail("expected a digit");
+			while (peek() >= '0' && peek() <= '9') ++position;
+		};
+		if (peek() == '-') ++position;
+		if (peek() == '0')
+			++position;
+		else if (peek() >= '1' && peek() <= '9')
+			digits();
+		else
+			fail("expected a value");
+		if (peek() == '.') {
+			++position;
+			digits();
+		}
+		if (peek() == 'e' || peek() == 'E') {
+			++position;
+			if (peek() == '+' || peek() == '-') ++position;
+			digits();
+		}
+	}
+
+	void Reader::skip_word(const char* word) {
+		const std::size_t length = std::strlen(word);
+		if (size - position < length
+			|| std::memcmp(data + position, word, length) != 0)
+			fail("expected a value");
+		position += length;
+	}
+
+	Reference<const Value> Reader::value(int line, int column) {
+
+		space();
+		switch (data[position]) {
+
+		case '{':
+			{
+				++position;
+				Reference<Dictionary> result(new Dictionary(line, column));
+				if (!next('}')) {
+					do {
+						space();
+						const std::string key = string();
+						expect(':');
+						result->set(escape ? escape(key) : key,
+							value(line, column));
+					} while (next(','));
+					expect('}');
+				}
+				return static_reference_cast<const Value>(result);
+			}
+
+		case '[':
+			{
+				++position;
+				Reference<List> result(new List(line, column));
+				if (!next(']')) {
+					do {
+						result->add(value(line, column));
+					} while (next(','));
+					expect(']');
+				}
+				return static_reference_cast<const Value>(result);
+			}
+
+		case '"':
+			{
+				std::string result = string();
+				if (escape) result = escape(result);
+				return Reference<const Value>(new Content(line, column,
+					result));
+			}
+
+		case 't':
+			position += 4;
+			return Reference<const Value>(new Data(line, column, 1));
+
+		case 'f':
+			position += 5;
+			return Reference<const Value>(new Data(line, column, 0));
+
+		case 'n':
+			position += 4;
+			return Reference<const Value>(new Content(line, column, ""));
+
+		default:
+			{
+				char* end;
+				const double result = std::strtod(data + position, &end);
+				position = end - data;
+				return Reference<const Value>(new Data(line, column,
+					result));
+			}
+
+		}
+
+	}
+
+	/**
+	 * Decode a string, whose surrogate pairs become single code points and
+	 * whose unpaired surrogates become replacement characters.
+	 */
+	std::string Reader::string() {
+
+		std::string result;
+		++position;
+
+		while (true) {
+
+			const std::size_t run = plain_run();
+			result.append(data + position, run);
+			position += run;
+			if (data[position] == '"') break;
+
+			const char escaped = data[++position];
+			++position;
+			switch (escaped) {
+			case 'b': result += '\b'; continue;
+			case 'f': result += '\f'; continue;
+			case 'n': result += '\n'; continue;
+			case 'r': result += '\r'; continue;
+			case 't': result += '\t'; continue;
+			case 'u': break;
+			default: result += escaped; continue;
+			}
+
+			const auto hex = [this](std::size_t at) {
+				return long(hex_value(data[at])) << 12
+					| hex_value(data[at + 1]) << 8
+					| hex_value(data[at + 2]) << 4 | hex_value(data[at + 3]);
+			};
+			long point = hex(position);
+			position += 4;
+			if (point >= 0xd800 && point <= 0xdbff && data[position] == '\\'
+				&& data[position + 1] == 'u') {
+				const long low = hex(position + 2);
+				if (low >= 0xdc00 && low <= 0xdfff) {
+					point = 0x10000 + ((point - 0xd800) << 10)
+						+ (low - 0xdc00);
+					position += 6;
+				}
+			}
+			if (point >= 0xd800 && point <= 0xdfff)
+				point = 0xfffd;
+			encode(point, result);
+
+		}
+
+		++position;
+		return result;
+
+	}
+
+	/**
+	 * The members of one object, by name, as a Context::Provider. Each is
+	 * decoded the first time it's asked for.
+	 */
+	class Members {
+	public:
+
+		Members(const std::shared_ptr<const std::string>& text,
+			Json::Escape escape) : text(text), escape(escape) {}
+
+		Reference<const Expression> operator()(Symbol name) {
+			auto cached = decoded.find(name);
+			if (cached != decoded.end())
+				return cached->second;
+			auto member = positions.find(name.string());
+			if (member == positions.end())
+				return Reference<const Expression>();
+			Reference<const Expression> result(Reader(*text, member->second,
+				escape).value(0, 0));
+			decoded.insert({name, result});
+			return result;
+		}
+
+		std::unordered_map<std::string, std::size_t> positions;
+
+	private:
+
+		std::shared_ptr<const std::string> text;
+		Json::Escape escape;
+		std::unordered_map<Symbol, Reference<const Expression>> decoded;
+
+	};
+
+	/**
+	 * Make the members of an object the definitions of the current
+	 * namespace, and its member objects namespaces of their own, giving the
+	 * position after the object. Only names that could be written in a
+	 * qualified name get namespaces.
+	 */
+	std::size_t define_object(Context& context,
+		const std::shared_ptr<const std::string>& text, std::size_t position,
+		Json::Escape escape) {
+
+		const auto members = std::make_shared<Members>(text, escape);
+		Reader reader(*text, position);
+		reader.expect('{');
+
+		if (!reader.next('}')) {
+			do {
+				reader.space();
+				const std::string key = reader.string();
+				reader.expect(':');
+				reader.space();
+				const std::size_t begin = reader.position;
+				if (reader.peek() == '{' && !key.empty()
+					&& key.find("::") == std::string::npos) {
+					context.enter_scope(key);
+					reader.position = define_object(context, text, begin,
+						escape);
+					context.exit_scope();
+				} else {
+					reader.skip_value();
+				}
+				members->positions[key] = begin;
+			} while (reader.next(','));
+			reader.expect('}');
+		}
+
+		context.provide([members](Symbol name) {
+			return (*members)(name);
+		});
+		return reader.position;
+
+	}
+
+}
+
+
+/**
+ * Read a document, checking all of it.
+ */
+Json::Json(const std::string& source)
+	: text(std::make_shared<const std::string>(source)) {
+	Reader reader(*text, 0);
+	reader.skip_value();
+	reader.space();
+	if (reader.position != text->size())
+		reader.fail("expected the end of the document");
+}
+
+
+/**
+ * Decode the whole document.
+ */
+Reference<const Value> Json::value(int line, int column) const {
+	return Reader(*text, 0).value(line, column);
+}
+
+
+/**
+ * Define the members of the document, which must be an object, in the
+ * current namespace, escaping strings if there's an escape function.
+ */
+void Json::define(Context& context, Escape escape) const {
+	Reader reader(*text, 0);
+	reader.space();
+	if (reader.peek() != '{')
+		throw std::runtime_error("Expected a JSON object.");
+	define_object(context, text, reader.position, escape);
+}
+
+
+/**
+ * Whether a Content-Type is JSON: application/json, or anything with the
+ * +json suffix, with any parameters.
+ */
+bool Json::describes(const std::string& content_type) {
+	std::string type = content_type.substr(0, content_type.find(';'));
+	while (!type.empty() && type.back() == ' ') type.pop_back();
+	for (auto i = type.begin(); i != type.end(); ++i)
+		if (*i >= 'A' && *i <= 'Z') *i += 'a' - 'A';
+	return type == "application/json" || (type.size() > 5
+		&& type.compare(type.size() - 5, 5, "+json") == 0);
+}
@@ -0,0 +1,46 @@
+#ifndef JSON_H
+#define JSON_H
+#include "Reference.h"
+#include "Value.h"
+#include <memory>
+#include <string>
+
+
+class Context;
+
+
+/**
+ * A JSON document. The whole document is checked as soon as it's read, but
+ * nothing is decoded until it's used. Objects become Dictionaries, arrays
+ * Lists, strings Content, and numbers Data, as do true and false, which are 1
+ * and 0; null is empty Content, so that it keeps its place in an array. Lists
+ * don't nest, so neither do arrays.
+ *
+ * An object can also be defined as a tree of namespaces, with a Provider for
+ * the members of each object, so that a request body can be read as
+ * POST::user::name without the rest of it, however big, being decoded.
+ *
+ * An escape function, if there is one, applies to strings and to the keys of
+ * Dictionaries, but not to the names of members defined in a namespace, which
+ * are only ever looked up, never output.
+ */
+class Json {
+public:
+
+	typedef std::string (*Escape)(const std::string&);
+
+	explicit Json(const std::string&);
+
+	Reference<const Value> value(int, int) const;
+	void define(Context&, Escape = nullptr) const;
+
+	static bool describes(const std::string&);
+
+private:
+
+	std::shared_ptr<const std::string> text;
+
+};
+
+
+#endif
@@ -1,39 +1,266 @@
 #include "List.h"
+#include "Data.h"
+#include "Image.h"
+#include "Vector.h"
 #include <algorithm>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 
 
-List::List(int line, int column) : Value(line, column) {}
+namespace {
+
+	/**
+	 * Lists shorter than this are copied when added to another List, rather
+	 * than shared, so that building a List out of lots of little ones doesn't
+	 * leave it in lots of little pieces.
+	 */
+	const std::size_t share_threshold = 32;
+
+	/**
+	 * Flattening a List makes a vector of all of its elements, which for a
+	 * long range can be far more than there's memory for.
+	 */
+	const std::size_t flatten_limit = 1 << 26;
+
+	/**
+	 * Lists are reduced this many numbers at a time.
+	 */
+	const std::size_t chunk_size = 1024;
+
+	void check_flatten(std::size_t length) {
+		if (length > flatten_limit) {
+			std::ostringstream message;
+			message << "List of " << length << " elements is too long to "
+				"flatten.";
+			throw std::runtime_error(message.str());
+		}
+	}
+
+}
+
+
+List::List(int line, int column) : Value(line, column), length(0) {}
 
 
 List::List(int line, int column,
-	const std::vector<std::shared_ptr<const Value>>& value) :
-	Value(line, column), value(value) {}
+	const std::vector<Reference<const Value>>& value) :
+	Value(line, column), value(value), length(value.size()) {}
 
 
 List::~List() {}
 
 
+/**
+ * A List of size numbers from start, step apart. The numbers are only made
+ * into Values one at a time as they're asked for, and not at all when the
+ * List is only used as data.
+ */
+Reference<const List> List::range(int line, int column, double start,
+	double step, std::size_t size) {
+	Reference<List> result(new List(line, column));
+	result->append(Segment{nullptr, 0, size, 0, false, start, step});
+	return static_reference_cast<const List>(result);
+}
+
+
+Reference<const Value> List::Segment::at(std::size_t index) const {
+	if (values)
+		return (*values)[position(index)];
+	return Reference<const Value>(new Data(0, 0, number(index)));
+}
+
+
 /**
  * Add to the List. I know, I know, I claim to be in the immutability camp, but
- * honestly, trade-offs have got to be made somewhere.
+ * honestly, trade-offs have got to be made somewhere. At least the elements of
+ * a long List that's added are shared rather than copied.
  */
-void List::add(std::shared_ptr<const Value> element) {
-	if (std::shared_ptr<const List> list =
-		std::dynamic_pointer_cast<const List>(element)) {
-		for (auto i = list->value.begin(); i != list->value.end(); ++i)
-			value.push_back(*i);
+void List::add(Reference<const Value> element) {
+	if (Reference<const List> list =
+		dynamic_reference_cast<const List>(element)) {
+		if (list->length >= share_threshold) {
+			list->share();
+			const auto& pieces = list->segments;
+			for (auto i = pieces.begin(); i != pieces.end(); ++i)
+				append(*i);
+		} else {
+			Values& values = tail();
+			list->each([&values](const Reference<const Value>& element) {
+				values.push_back(element);
+			});
+			if (!segments.empty()) segments.back().size += list->length;
+			length += list->length;
+		}
 	} else {
-		value.push_back(element);
+		tail().push_back(element);
+		if (!segments.empty()) ++segments.back().size;
+		++length;
+	}
+}
+
+
+/**
+ * Make room for some number of elements, for those who know how many they'll
+ * be adding.
+ */
+void List::reserve(std::size_t size) {
+	Values& values = tail();
+	values.reserve(values.size() + size);
+}
+
+
+/**
+ * Call a function with each element in order.
+ */
+template<class Function>
+void List::each(Function function) const {
+	if (segments.empty()) {
+		for (auto i = value.begin(); i != value.end(); ++i)
+			function(*i);
+		return;
 	}
+	for (auto i = segments.begin(); i != segments.end(); ++i)
+		for (std::size_t j = 0; j < i->size; ++j)
+			function(i->at(j));
+}
+
+
+/**
+ * Move the elements that this List owns into a shared vector, so that other
+ * Lists can have views of them. That doesn't change the elements, and so is
+ * fair game even for a const List.
+ */
+void List::share() const {
+	if (!segments.empty() || value.empty()) return;
+	const std::size_t size = value.size();
+	segments.push_back(Segment{std::make_shared<Values>(std::move(value)), 0,
+		size, 0, false, 0, 0});
+	value.clear();
+}
+
+
+/**
+ * Add a view of a segment to the end of the List, joining it to the last one
+ * if they happen to be adjacent, as when a List is sliced and put back
+ * together.
+ */
+void List::append(Segment segment) {
+
+	share();
+	if (segment.size == 0) return;
+
+	if (!segments.empty()) {
+		Segment& last = segments.back();
+		if (last.values == segment.values && !last.reversed
+			&& !segment.reversed && last.begin + last.size == segment.begin
+			&& (last.values || (last.start == segment.start
+			&& last.step == segment.step))) {
+			last.size += segment.size;
+			length += segment.size;
+			return;
+		}
+		if (last.size == 0)
+			segments.pop_back();
+	}
+
+	segment.offset = length;
+	segments.push_back(segment);
+	length += segment.size;
+
+}
+
+
+/**
+ * The vector that new elements go into. That's the List's own, unless it has
+ * been shared; only a shared vector that nobody else can see yet, and that
+ * the last segment runs to the end of, can be added to, and otherwise a new
+ * one is started.
+ */
+List::Values& List::tail() {
+	if (segments.empty()) return value;
+	const Segment& last = segments.back();
+	if (!last.reversed && last.values.use_count() == 1
+		&& last.begin + last.size == last.values->size())
+		return *last.values;
+	segments.push_back(Segment{std::make_shared<Values>(), 0, 0, length,
+		false, 0, 0});
+	return *segments.back().values;
+}
+
+
+/**
+ * Get an element by position, in constant time for a List in one piece and
+ * logarithmic in the number of pieces otherwise.
+ */
+Reference<const Value> List::at(std::size_t index) const {
+
+	if (index >= length)
+		throw std::logic_error("List index out of range.");
+
+	if (segments.empty())
+		return value[index];
+
+	if (segments.size() == 1)
+		return segments.front().at(index);
+
+	auto segment = std::upper_bound(segments.begin(), segments.end(), index,
+		[](std::size_t position, const Segment& segment) {
+			return position < segment.offset;
+		});
+	--segment;
+	return segment->at(index - segment->offset);
+
+}
+
+
+/**
+ * A List of count elements from start, sharing this List's elements.
+ */
+Reference<const List> List::slice(std::size_t start,
+	std::size_t count) const {
+
+	Reference<List> result(new List(line_number, column_number));
+	if (start >= length) return static_reference_cast<const List>(result);
+	share();
+	const std::size_t end = start + std::min(count, length - start);
+
+	for (auto i = segments.begin(); i != segments.end(); ++i) {
+		const std::size_t first = std::max(start, i->offset);
+		const std::size_t last = std::min(end, i->offset + i->size);
+		if (first >= last) continue;
+		Segment segment(*i);
+		segment.size = last - first;
+		segment.begin += i->reversed ? i->offset + i->size - last
+			: first - i->offset;
+		result->append(segment);
+	}
+
+	return static_reference_cast<const List>(result);
+
+}
+
+
+/**
+ * This List backwards, sharing its elements.
+ */
+Reference<const List> List::reverse() const {
+	share();
+	Reference<List> result(new List(line_number, column_number));
+	for (auto i = segments.rbegin(); i != segments.rend(); ++i) {
+		Segment segment(*i);
+		segment.reversed = !segment.reversed;
+		result->append(segment);
+	}
+	return static_reference_cast<const List>(result);
 }
 
 
 /**
  * A List is a List is a List.
  */
-std::shared_ptr<const List> List::evaluate(Context&) const {
-	return std::static_pointer_cast<const List>(self_reference());
+Reference<const List> List::evaluate(Context&) const {
+	return static_reference_cast<const List>(self_reference());
 }
 
 
@@ -42,17 +269,23 @@ std::shared_ptr<const List> List::evaluate(Context&) const {
  */
 std::string List::get_content() const {
 	std::ostringstream stream;
-	for (auto i = value.begin(); i != value.end(); ++i)
-		stream << (*i)->get_content();
+	write_content(stream);
 	return stream.str();
 }
 
 
+void List::write_content(std::ostream& stream) const {
+	each([&stream](const Reference<const Value>& element) {
+		element->write_content(stream);
+	});
+}
+
+
 /**
  * Grab the first datum. I didn't really know what else to do here.
  */
 double List::get_data() const {
-	return value.empty() ? 0 : value[0]->get_data();
+	return length == 0 ? 0 : at(0)->get_data();
 }
 
 
@@ -60,9 +293,12 @@ double List::get_data() const {
  * Flatten each element into content, but don't flatten the whole container.
  */
 std::vector<std::string> List::flat_content() const {
+	check_flatten(length);
 	std::vector<std::string> result;
-	for (auto i = value.begin(); i != value.end(); ++i)
-		result.push_back((*i)->get_content());
+	result.reserve(length);
+	each([&result](const Reference<const Value>& element) {
+		result.push_back(element->get_content());
+	});
 	return result;
 }
 
@@ -71,11 +307,112 @@ std::vector<std::string> List::flat_content() const {
  * Flatten each element into data, but again, don't flatten the List.
  */
 std::vector<double> List::flat_data() const {
+	check_flatten(length);
 	std::vector<double> result;
-	for (auto i = value.begin(); i != value.end(); ++i)
-		result.push_back((*i)->get_data());
+	result.reserve(length);
+	if (segments.empty()) {
+		for (auto i = value.begin(); i != value.end(); ++i)
+			result.push_back((*i)->get_data());
+		return result;
+	}
+	for (auto i = segments.begin(); i != segments.end(); ++i)
+		for (std::size_t j = 0; j < i->size; ++j)
+			result.push_back(i->values ? i->at(j)->get_data() : i->number(j));
+	return result;
+}
+
+
+/**
+ * Pass the data of the elements to one function a chunk at a time, and each
+ * segment of a range to another as it is, so that a List can be reduced
+ * without being flattened, however long it is.
+ */
+template<class Chunk, class Run>
+void List::each_data(Chunk chunk, Run run) const {
+
+	double buffer[chunk_size];
+	std::size_t used = 0;
+	const auto push = [&](double datum) {
+		buffer[used++] = datum;
+		if (used == chunk_size) {
+			chunk(buffer, used);
+			used = 0;
+		}
+	};
+
+	if (segments.empty()) {
+		for (auto i = value.begin(); i != value.end(); ++i)
+			push((*i)->get_data());
+	} else {
+		for (auto i = segments.begin(); i != segments.end(); ++i) {
+			if (!i->values) {
+				if (i->size) run(*i);
+				continue;
+			}
+			for (std::size_t j = 0; j < i->size; ++j)
+				push(i->at(j)->get_data());
+		}
+	}
+
+	if (used) chunk(buffer, used);
+
+}
+
+
+/**
+ * The sum of the data. A range adds up in closed form.
+ */
+double List::sum() const {
+	double result = 0;
+	each_data([&result](const double* data, std::size_t size) {
+		result += vector_sum(data, size);
+	}, [&result](const Segment& segment) {
+		const double size = segment.size;
+		result += size * segment.start + segment.step
+			* (size * segment.begin + size * (size - 1) / 2);
+	});
 	return result;
 }
 
 
+/**
+ * The smallest datum, or infinity for an empty List. A range is smallest at
+ * one end or the other.
+ */
+double List::minimum() const {
+	double result = std::numeric_limits<double>::infinity();
+	each_data([&result](const double* data, std::size_t size) {
+		result = std::min(result, vector_min(data, size));
+	}, [&result](const Segment& segment) {
+		result = std::min(result, std::min(segment.number(0),
+			segment.number(segment.size - 1)));
+	});
+	return result;
+}
+
+
+double List::maximum() const {
+	double result = -std::numeric_limits<double>::infinity();
+	each_data([&result](const double* data, std::size_t size) {
+		result = std::max(result, vector_max(data, size));
+	}, [&result](const Segment& segment) {
+		result = std::max(result, std::max(segment.number(0),
+			segment.number(segment.size - 1)));
+	});
+	return result;
+}
+
+
+
+void List::write(Image& image) const {
+	image.write_tag(Image::LIST);
+	image.write_integer(line_number);
+	image.write_integer(column_number);
+	image.write_integer(length);
+	each([&image](const Reference<const Value>& element) {
+		image.write_expression(element);
+	});
+}
+
+
 List* List::clone() const { return new List(*this); }
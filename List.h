@@ -1,35 +1,98 @@
 #ifndef LIST_H
 #define LIST_H
+#include "Reference.h"
 #include "Value.h"
+#include <cstddef>
 #include <memory>
 #include <vector>
 
 
 /**
- * A list of Values.
+ * A list of Values. Most Lists are short and simply own their elements. Once a
+ * List is sliced, reversed, or added to another, though, its elements move to
+ * a vector that is shared between Lists and never changed again, and a List
+ * becomes a sequence of views, or segments, into such vectors. That makes
+ * slicing, reversing, and joining long Lists cost a few segments rather than a
+ * copy of every element.
  */
 class List : public Value {
 public:
 
 	List(int, int);
-	List(int, int, const std::vector<std::shared_ptr<const Value>>&);
+	List(int, int, const std::vector<Reference<const Value>>&);
 	virtual ~List();
 
-	void add(std::shared_ptr<const Value>);
-	virtual std::shared_ptr<const List> evaluate(Context&) const;
+	void add(Reference<const Value>);
+	void reserve(std::size_t);
+	virtual Reference<const List> evaluate(Context&) const;
 	virtual std::string get_content() const;
 	virtual double get_data() const;
+	virtual void write(Image&) const;
+	virtual void write_content(std::ostream&) const;
 
 	std::vector<std::string> flat_content() const;
 	std::vector<double> flat_data() const;
 
+	double sum() const;
+	double minimum() const;
+	double maximum() const;
+
+	std::size_t size() const { return length; }
+	Reference<const Value> at(std::size_t) const;
+
+	Reference<const List> slice(std::size_t, std::size_t) const;
+	Reference<const List> reverse() const;
+
+	static Reference<const List> range(int, int, double, double,
+		std::size_t);
+
 protected:
 
 	virtual List* clone() const;
 
 private:
 
-	std::vector<std::shared_ptr<const Value>> value;
+	typedef std::vector<Reference<const Value>> Values;
+
+	/**
+	 * A run of elements from a shared vector, or else from the sequence
+	 * start, start + step, start + 2 * step..., possibly in reverse order,
+	 * starting at some offset in the List.
+	 */
+	struct Segment {
+
+		std::size_t position(std::size_t index) const {
+			return reversed ? begin + size - 1 - index : begin + index;
+		}
+
+		double number(std::size_t index) const {
+			return start + step * position(index);
+		}
+
+		Reference<const Value> at(std::size_t) const;
+
+		std::shared_ptr<Values> values;
+		std::size_t begin;
+		std::size_t size;
+		std::size_t offset;
+		bool reversed;
+		double start;
+		double step;
+
+	};
+
+	template<class Function>
+	void each(Function) const;
+	template<class Chunk, class Run>
+	void each_data(Chunk, Run) const;
+
+	void append(Segment);
+	void share() const;
+	Values& tail();
+
+	mutable Values value;
+	mutable std::vector<Segment> segments;
+	std::size_t length;
 
 };
 
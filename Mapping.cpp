@@ -0,0 +1,86 @@
+#include "Mapping.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+Mapping::Mapping() : file(-1), mapped(false), address(nullptr), length(0),
+	device(0), inode(0), modified{0, 0} {}
+
+
+Mapping::~Mapping() {
+	if (mapped) munmap(const_cast<char*>(address), length);
+	if (file != -1) close(file);
+}
+
+
+/**
+ * Map a file, or read it if it can't be mapped, or return null if it can't be
+ * opened or read at all.
+ */
+std::shared_ptr<const Mapping> Mapping::open(const std::string& path) {
+
+	std::shared_ptr<Mapping> result(new Mapping());
+	struct stat status;
+
+	if ((result->file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC)) == -1
+		|| fstat(result->file, &status) != 0)
+		return nullptr;
+
+	if (S_ISREG(status.st_mode) && status.st_size) {
+		void* address = mmap(nullptr, status.st_size, PROT_READ,
+			MAP_PRIVATE, result->file, 0);
+		if (address != MAP_FAILED) {
+			result->mapped = true;
+			result->address = static_cast<const char*>(address);
+			result->length = status.st_size;
+			result->device = status.st_dev;
+			result->inode = status.st_ino;
+			result->modified = status.st_mtim;
+			return result;
+		}
+	}
+
+	if (!result->read())
+		return nullptr;
+	return result;
+
+}
+
+
+/**
+ * Read the whole file from its descriptor, however long it turns out to be,
+ * and let the descriptor go.
+ */
+bool Mapping::read() {
+
+	char buffer[1 << 16];
+	while (true) {
+		const ssize_t size = ::read(file, buffer, sizeof(buffer));
+		if (size == -1 && errno == EINTR) continue;
+		if (size < 0) return false;
+		if (size == 0) break;
+		contents.append(buffer, size);
+	}
+
+	close(file);
+	file = -1;
+	address = contents.data();
+	length = contents.size();
+	return true;
+
+}
+
+
+/**
+ * Whether the file a path now names is still the one that was mapped, as far
+ * as its identity, size, and modification time can tell.
+ */
+bool Mapping::matches(const struct stat& status) const {
+	return mapped && status.st_dev == device && status.st_ino == inode
+		&& std::size_t(status.st_size) == length
+		&& status.st_mtim.tv_sec == modified.tv_sec
+		&& status.st_mtim.tv_nsec == modified.tv_nsec;
+}
@@ -0,0 +1,54 @@
+#ifndef MAPPING_H
+#define MAPPING_H
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+
+struct stat;
+
+
+/**
+ * A whole file mapped read-only into memory. The file stays open for as long
+ * as the Mapping lives, so that its contents can also be handed to the kernel
+ * by descriptor.
+ *
+ * Only a regular file with something in it can be mapped. Anything else, such
+ * as a pipe, or a file in /proc that claims to be empty, is read into memory
+ * instead, and has no descriptor. What's read can't be known to be unchanged
+ * the next time, so it never matches.
+ */
+class Mapping {
+public:
+
+	static std::shared_ptr<const Mapping> open(const std::string&);
+	~Mapping();
+
+	const char* data() const { return address; }
+	std::size_t size() const { return length; }
+	int descriptor() const { return file; }
+	bool matches(const struct stat&) const;
+
+private:
+
+	Mapping();
+	Mapping(const Mapping&) = delete;
+	Mapping& operator=(const Mapping&) = delete;
+
+	bool read();
+
+	int file;
+	bool mapped;
+	std::string contents;
+	const char* address;
+	std::size_t length;
+	dev_t device;
+	ino_t inode;
+	timespec modified;
+
+};
+
+
+#endif
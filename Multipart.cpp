@@ -0,0 +1,316 @@
+#include "Multipart.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+
+namespace {
+
+	/**
+	 * Ordinary fields bigger than this are assumed to be up to no good.
+	 */
+	const std::size_t field_limit = 1 << 20;
+
+	/**
+	 * Likewise the headers of any one part.
+	 */
+	const std::size_t header_limit = 1 << 14;
+
+	/**
+	 * What each part is counted as, on top of its name and value, so that
+	 * a flood of empty parts runs into the total limit too.
+	 */
+	const std::size_t part_overhead = 256;
+
+	std::string lowercase(std::string value) {
+		std::transform(value.begin(), value.end(), value.begin(),
+			[](unsigned char c) { return std::tolower(c); });
+		return value;
+	}
+
+	std::string trim(const std::string& value) {
+		const auto begin = value.find_first_not_of(" \t");
+		if (begin == std::string::npos) return "";
+		const auto end = value.find_last_not_of(" \t");
+		return value.substr(begin, end - begin + 1);
+	}
+
+	/**
+	 * Split a header value like "form-data; name=\"x\"" into its first
+	 * part and its parameters, keyed in lowercase, with quotes removed.
+	 */
+	std::string parameters(const std::string& header,
+		std::map<std::string, std::string>& result) {
+
+		std::istringstream stream(header);
+		std::string first;
+		std::getline(stream, first, ';');
+
+		std::string parameter;
+		while (std::getline(stream, parameter, ';')) {
+			const auto equals = parameter.find('=');
+			if (equals == std::string::npos) continue;
+			std::string value = trim(parameter.substr(equals + 1));
+			if (value.size() >= 2 && value.front() == '"'
+				&& value.back() == '"')
+				value = value.substr(1, value.size() - 2);
+			result[lowercase(trim(parameter.substr(0, equals)))] = value;
+		}
+
+		return lowercase(trim(first));
+
+	}
+
+}
+
+
+/**
+ * The body is treated as though it began with a line break, so that the
+ * first boundary looks like all the others. The limit is on everything kept
+ * in memory, for all the parts together.
+ */
+Multipart::Multipart(const std::string& boundary, std::size_t limit) :
+	state(PREAMBLE), delimiter("\r\n--" + boundary), pending("\r\n"),
+	file(-1), limit(limit), stored(0) {
+	upload.size = 0;
+	if (boundary.empty())
+		throw std::runtime_error("Missing multipart/form-data boundary.");
+}
+
+
+/**
+ * Uploads are only good for as long as the request is.
+ */
+Multipart::~Multipart() {
+	if (file != -1) {
+		close(file);
+		unlink(upload.path.c_str());
+	}
+	for (auto i = uploads.begin(); i != uploads.end(); ++i)
+		unlink(i->second.path.c_str());
+}
+
+
+/**
+ * Extract the boundary from a Content-Type, if it's multipart/form-data.
+ */
+std::string Multipart::boundary(const std::string& content_type) {
+	std::map<std::string, std::string> result;
+	if (parameters(content_type, result) != "multipart/form-data")
+		return "";
+	return result["boundary"];
+}
+
+
+void Multipart::feed(const char* data, std::size_t size) {
+	pending.append(data, size);
+	while (step()) {}
+}
+
+
+void Multipart::finish() {
+	if (state != EPILOGUE)
+		throw std::runtime_error("Incomplete multipart/form-data request.");
+}
+
+
+/**
+ * Make as much progress as the pending input allows. Anything that might be
+ * the start of a delimiter is held back until there's enough to tell.
+ */
+bool Multipart::step() {
+
+	switch (state) {
+
+	case PREAMBLE:
+		{
+			const auto position = pending.find(delimiter);
+			if (position == std::string::npos) {
+				if (pending.size() >= delimiter.size())
+					pending.erase(0, pending.size() - delimiter.size() + 1);
+				return false;
+			}
+			pending.erase(0, position + delimiter.size());
+			state = DELIMITER;
+			return true;
+		}
+
+	case DELIMITER:
+		{
+			if (pending.size() < 2) return false;
+			if (pending.compare(0, 2, "--") == 0) {
+				state = EPILOGUE;
+				return true;
+			}
+			const auto position = pending.find("\r\n");
+			if (position == std::string::npos) {
+				if (pending.size() > header_limit)
+					throw std::runtime_error
+						("Malformed multipart/form-data boundary.");
+				return false;
+			}
+			pending.erase(0, position + 2);
+			state = HEADERS;
+			return true;
+		}
+
+	case HEADERS:
+		{
+			const auto position = pending.compare(0, 2, "\r\n") == 0 ? 0 :
+				pending.find("\r\n\r\n");
+			if (position == std::string::npos) {
+				if (pending.size() > header_limit)
+					throw std::runtime_error
+						("Malformed multipart/form-data headers.");
+				return false;
+			}
+			begin(pending.substr(0, position));
+			pending.erase(0, position == 0 ? 2 : position + 4);
+			state = BODY;
+			return true;
+		}
+
+	case BODY:
+		{
+			const auto position = pending.find(delimiter);
+			if (position == std::string::npos) {
+				const std::size_t keep = delimiter.size() - 1;
+				if (pending.size() > keep) {
+					write(pending.data(), pending.size() - keep);
+					pending.erase(0, pending.size() - keep);
+				}
+				return false;
+			}
+			write(pending.data(), position);
+			end();
+			pending.erase(0, position + delimiter.size());
+			state = DELIMITER;
+			return true;
+		}
+
+	case EPILOGUE:
+		pending.clear();
+		return false;
+
+	}
+
+	return false;
+
+}
+
+
+/**
+ * Start a part. Parts with a filename are files; parts with an empty one are
+ * file inputs with nothing chosen, and are ignored; the rest are fields.
+ */
+void Multipart::begin(const std::string& headers) {
+
+	name.clear();
+	value.clear();
+	upload = Upload();
+	upload.size = 0;
+
+	std::map<std::string, std::string> disposition;
+	bool has_filename = false;
+	std::istringstream stream(headers);
+	std::string line;
+
+	while (std::getline(stream, line)) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		const auto colon = line.find(':');
+		if (colon == std::string::npos) continue;
+		const std::string header = lowercase(trim(line.substr(0, colon)));
+		const std::string content = trim(line.substr(colon + 1));
+		if (header == "content-disposition") {
+			parameters(content, disposition);
+			has_filename = disposition.count("filename");
+			upload.filename = disposition["filename"];
+			name = disposition["name"];
+		} else if (header == "content-type") {
+			upload.type = content;
+		}
+	}
+
+	if (!has_filename) return;
+	if (upload.filename.empty()) {
+		name.clear();
+		return;
+	}
+
+	const char* directory = std::getenv("TMPDIR");
+	upload.path = std::string(directory && *directory ? directory : "/tmp")
+		+ "/vision-upload-XXXXXX";
+	if ((file = mkstemp(&upload.path[0])) == -1)
+		throw std::runtime_error("Unable to save upload.");
+
+}
+
+
+void Multipart::write(const char* data, std::size_t size) {
+
+	if (file != -1) {
+		upload.size += size;
+		while (size) {
+			const ssize_t result = ::write(file, data, size);
+			if (result == -1 && errno == EINTR) continue;
+			if (result <= 0)
+				throw std::runtime_error("Unable to save upload.");
+			data += result;
+			size -= result;
+		}
+		return;
+	}
+
+	if (name.empty()) return;
+
+	if (value.size() + size > field_limit) {
+		std::ostringstream message;
+		message << "Form field \"" << name << "\" is too large.";
+		throw std::runtime_error(message.str());
+	}
+
+	store(size);
+	value.append(data, size);
+
+}
+
+
+/**
+ * Finish a part. A later field or file of the same name replaces an earlier
+ * one, as with URL-encoded input, but still counts towards the limit.
+ */
+void Multipart::end() {
+
+	if (file != -1) {
+		store(part_overhead + name.size() + upload.path.size()
+			+ upload.filename.size() + upload.type.size());
+		const bool closed = close(file) == 0;
+		file = -1;
+		if (!closed) {
+			unlink(upload.path.c_str());
+			throw std::runtime_error("Unable to save upload.");
+		}
+		auto existing = uploads.find(name);
+		if (existing != uploads.end())
+			unlink(existing->second.path.c_str());
+		uploads[name] = upload;
+	} else if (!name.empty()) {
+		store(part_overhead + name.size());
+		fields[name] = value;
+	}
+
+}
+
+
+/**
+ * Count bytes about to be kept in memory against the limit.
+ */
+void Multipart::store(std::size_t size) {
+	if (size > limit - stored)
+		throw std::runtime_error("Form fields are too large.");
+	stored += size;
+}
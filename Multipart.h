@@ -0,0 +1,82 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+#include <cstddef>
+#include <map>
+#include <string>
+
+
+/**
+ * A streaming parser for multipart/form-data request bodies. The body is fed
+ * in chunks of any size; ordinary fields are kept in memory, up to a limit
+ * for each and one for all of them together, and file parts go straight to
+ * temporary files, so memory use doesn't grow with the size of an upload.
+ * The temporary files are deleted along with the parser.
+ */
+class Multipart {
+public:
+
+	/**
+	 * An uploaded file, as saved on disk.
+	 */
+	struct Upload {
+
+		std::string path;
+		std::string filename;
+		std::string type;
+		long long size;
+
+	};
+
+	Multipart(const std::string&, std::size_t);
+	~Multipart();
+
+	void feed(const char*, std::size_t);
+	void finish();
+
+	const std::map<std::string, std::string>& get_fields() const {
+		return fields;
+	}
+
+	const std::map<std::string, Upload>& get_uploads() const {
+		return uploads;
+	}
+
+	static std::string boundary(const std::string&);
+
+private:
+
+	Multipart(const Multipart&) = delete;
+	Multipart& operator=(const Multipart&) = delete;
+
+	enum State {
+		PREAMBLE,
+		DELIMITER,
+		HEADERS,
+		BODY,
+		EPILOGUE,
+	};
+
+	bool step();
+	void begin(const std::string&);
+	void write(const char*, std::size_t);
+	void end();
+	void store(std::size_t);
+
+	State state;
+	std::string delimiter;
+	std::string pending;
+
+	std::string name;
+	std::string value;
+	Upload upload;
+	int file;
+	std::size_t limit;
+	std::size_t stored;
+
+	std::map<std::string, std::string> fields;
+	std::map<std::string, Upload> uploads;
+
+};
+
+
+#endif
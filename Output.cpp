@@ -0,0 +1,154 @@
+#include "Output.h"
+#include "Mapping.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+	const std::size_t buffer_size = 1 << 16;
+
+	/**
+	 * Mapped files smaller than this aren't worth a system call of their own,
+	 * and are just buffered.
+	 */
+	const std::size_t minimum_transfer = 1 << 16;
+
+	bool write_all(int descriptor, const char* data, std::size_t size) {
+		while (size) {
+			const ssize_t result = write(descriptor, data, size);
+			if (result == -1 && errno == EINTR) continue;
+			if (result <= 0) return false;
+			data += result;
+			size -= result;
+		}
+		return true;
+	}
+
+	/**
+	 * Whether a failed transfer means only that this particular pair of
+	 * descriptors doesn't support it, so that something else might work.
+	 */
+	bool unsupported(int error) {
+		return error == EINVAL || error == ENOSYS || error == EXDEV
+			|| error == EBADF || error == EOPNOTSUPP;
+	}
+
+}
+
+
+/**
+ * What the descriptor refers to decides how mapped files are sent to it.
+ */
+Output::Output(int descriptor) : descriptor(descriptor), kind(OTHER),
+	buffer(buffer_size) {
+	struct stat status;
+	if (fstat(descriptor, &status) == 0) {
+		if (S_ISREG(status.st_mode))
+			kind = FILE;
+		else if (S_ISFIFO(status.st_mode))
+			kind = PIPE;
+	}
+	setp(&buffer[0], &buffer[0] + buffer.size());
+}
+
+
+Output::~Output() { drain(); }
+
+
+/**
+ * Send the whole of a mapped file. Whatever the kernel won't transfer on its
+ * own is written from the mapping, as is all of a file that had to be read.
+ */
+bool Output::send(const Mapping& file) {
+
+	if (file.size() < minimum_transfer || file.descriptor() == -1)
+		return sputn(file.data(), file.size())
+			== std::streamsize(file.size());
+
+	if (!drain()) return false;
+
+	const std::size_t sent = transfer(file.descriptor(), file.size());
+	return write_all(descriptor, file.data() + sent, file.size() - sent);
+
+}
+
+
+Output::int_type Output::overflow(int_type c) {
+	if (!drain()) return traits_type::eof();
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+
+/**
+ * Anything too big to buffer is written directly.
+ */
+std::streamsize Output::xsputn(const char* data, std::streamsize size) {
+	if (size > epptr() - pptr()) {
+		if (!drain()) return 0;
+		if (size >= std::streamsize(buffer.size()))
+			return write_all(descriptor, data, size) ? size : 0;
+	}
+	std::memcpy(pptr(), data, size);
+	pbump(size);
+	return size;
+}
+
+
+int Output::sync() { return drain() ? 0 : -1; }
+
+
+bool Output::drain() {
+	const bool result = write_all(descriptor, pbase(), pptr() - pbase());
+	setp(&buffer[0], &buffer[0] + buffer.size());
+	return result;
+}
+
+
+/**
+ * Copy as much of a file as possible without it passing through user space:
+ * splice into a pipe, copy_file_range into a file, or sendfile into anything
+ * else. Each falls back to the next when the kernel declines, and anything
+ * that declines is not tried again. Returns how much was transferred.
+ */
+std::size_t Output::transfer(int file, std::size_t size) {
+
+	off_t offset = 0;
+
+	while (std::size_t(offset) < size) {
+
+		const std::size_t remaining = size - offset;
+		ssize_t result;
+
+		if (kind == PIPE)
+			result = splice(file, &offset, descriptor, nullptr, remaining,
+				SPLICE_F_MOVE);
+		else if (kind == FILE)
+			result = copy_file_range(file, &offset, descriptor, nullptr,
+				remaining, 0);
+		else
+			result = sendfile(descriptor, file, &offset, remaining);
+
+		if (result > 0) continue;
+		if (result == -1 && errno == EINTR) continue;
+
+		if (result == -1 && unsupported(errno) && kind != OTHER) {
+			kind = OTHER;
+			continue;
+		}
+
+		break;
+
+	}
+
+	return offset;
+
+}
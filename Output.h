@@ -0,0 +1,52 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <streambuf>
+#include <sys/types.h>
+#include <vector>
+
+
+class Mapping;
+
+
+/**
+ * A stream buffer that writes straight to a file descriptor. Mapped files
+ * sent through it skip user space entirely where the kernel allows: they are
+ * spliced into pipes, copied between files, or sent to anything else, and
+ * only written from memory as a last resort.
+ */
+class Output : public std::streambuf {
+public:
+
+	explicit Output(int);
+	virtual ~Output();
+
+	bool send(const Mapping&);
+
+protected:
+
+	virtual int_type overflow(int_type);
+	virtual std::streamsize xsputn(const char*, std::streamsize);
+	virtual int sync();
+
+private:
+
+	Output(const Output&) = delete;
+	Output& operator=(const Output&) = delete;
+
+	enum Kind {
+		FILE,
+		PIPE,
+		OTHER,
+	};
+
+	bool drain();
+	std::size_t transfer(int, std::size_t);
+
+	int descriptor;
+	Kind kind;
+	std::vector<char> buffer;
+
+};
+
+
+#endif
@@ -15,9 +15,9 @@ Token accept_token
 	(const std::list<Token>&, std::list<Token>::const_iterator&, Token::Type);
 Token expect_token
 	(const std::list<Token>&, std::list<Token>::const_iterator&, Token::Type);
-std::shared_ptr<const Expression> accept_expression
+Reference<const Expression> accept_expression
 	(const std::list<Token>&, std::list<Token>::const_iterator&);
-std::shared_ptr<const Expression> expect_expression
+Reference<const Expression> expect_expression
 	(const std::list<Token>&, std::list<Token>::const_iterator&);
 
 
@@ -64,12 +64,12 @@ Token expect_token(const std::list<Token>& tokens,
 /**
  * Accept an Expression of whatever sort from the buffer.
  */
-std::shared_ptr<const Expression> accept_expression
+Reference<const Expression> accept_expression
 	(const std::list<Token>& tokens,
 	std::list<Token>::const_iterator& current) {
 
-	std::shared_ptr<Expression> result;
-	std::shared_ptr<const Expression> expression;
+	Reference<Expression> result;
+	Reference<const Expression> expression;
 
 	// A number never names a thing of meaning.
 	// "I am not a number, I am a free man!"
@@ -78,7 +78,7 @@ std::shared_ptr<const Expression> accept_expression
 		std::istringstream stream(token.string);
 		double data;
 		stream >> data;
-		return std::shared_ptr<const Expression>(new Data
+		return Reference<const Expression>(new Data
 			(token.line, token.column, data));
 
 	}
@@ -97,12 +97,12 @@ std::shared_ptr<const Expression> accept_expression
 	} else if (Token token = accept_token
 		(tokens, current, Token::LEFT_BRACKET)) {
 
-		std::shared_ptr<Expression> block(new Block(token.line, token.column));
+		Reference<Expression> block(new Block(token.line, token.column));
 
 		do {
 
 			expression = expect_expression(tokens, current);
-			std::static_pointer_cast<Block>(block)->add(expression);
+			static_reference_cast<Block>(block)->add(expression);
 			if (current == tokens.end()) {
 				std::ostringstream message;
 				message << "Unexpected end of file in block beginning at line "
@@ -118,12 +118,12 @@ std::shared_ptr<const Expression> accept_expression
 	} else if (Token token = accept_token
 		(tokens, current, Token::LEFT_BRACE)) {
 
-		std::shared_ptr<Expression> block(new Block(token.line, token.column));
+		Reference<Expression> block(new Block(token.line, token.column));
 
 		do {
 
 			expression = expect_expression(tokens, current);
-			std::static_pointer_cast<Block>(block)->add(expression);
+			static_reference_cast<Block>(block)->add(expression);
 			if (current == tokens.end()) {
 				std::ostringstream message;
 				message << "Unexpected end of file in block beginning at line "
@@ -139,12 +139,12 @@ std::shared_ptr<const Expression> accept_expression
 	} else if (Token token = accept_token
 		(tokens, current, Token::LEFT_PARENTHESIS)) {
 
-		std::shared_ptr<Expression> group(new Group(token.line, token.column));
+		Reference<Expression> group(new Group(token.line, token.column));
 
 		do {
 
 			expression = expect_expression(tokens, current);
-			std::static_pointer_cast<Group>(group)->add(expression);
+			static_reference_cast<Group>(group)->add(expression);
 			if (current == tokens.end()) {
 				std::ostringstream message;
 				message << "Unexpected end of file in group beginning at line "
@@ -159,7 +159,7 @@ std::shared_ptr<const Expression> accept_expression
 	// \(o_O)/
 	} else {
 
-		return std::shared_ptr<const Expression>();
+		return Reference<const Expression>();
 
 	}
 
@@ -172,16 +172,16 @@ std::shared_ptr<const Expression> accept_expression
 		current->type == Token::LEFT_PARENTHESIS ||
 		current->type == Token::LEFT_BRACE) {
 
-		std::shared_ptr<Expression> compound(new Compound
+		Reference<Expression> compound(new Compound
 			(result->line_number, result->column_number));
-		std::static_pointer_cast<Compound>(compound)->set_determiner(result);
+		static_reference_cast<Compound>(compound)->set_determiner(result);
 		result = compound;
 
 	}
 
 	// [id]
 	if (accept_token(tokens, current, Token::LEFT_BRACKET)) {
-		std::static_pointer_cast<Compound>(result)->set_identifier
+		static_reference_cast<Compound>(result)->set_identifier
 			(expect_token(tokens, current, Token::IDENTIFIER).string);
 		expect_token(tokens, current, Token::RIGHT_BRACKET);
 	}
@@ -190,12 +190,12 @@ std::shared_ptr<const Expression> accept_expression
 	while (Token token = accept_token
 		(tokens, current, Token::LEFT_PARENTHESIS)) {
 
-		std::static_pointer_cast<Compound>(result)->add_data();
+		static_reference_cast<Compound>(result)->add_data();
 
 		do {
 
 			expression = expect_expression(tokens, current);
-			std::static_pointer_cast<Compound>(result)->add_data(expression);
+			static_reference_cast<Compound>(result)->add_data(expression);
 
 			if (current == tokens.end()) {
 				std::ostringstream message;
@@ -212,12 +212,12 @@ std::shared_ptr<const Expression> accept_expression
 	// {...}
 	while (Token token = accept_token(tokens, current, Token::LEFT_BRACE)) {
 
-		std::static_pointer_cast<Compound>(result)->add_content();
+		static_reference_cast<Compound>(result)->add_content();
 
 		do {
 
 			expression = expect_expression(tokens, current);
-			std::static_pointer_cast<Compound>
+			static_reference_cast<Compound>
 				(result)->add_content(expression);
 
 			if (current == tokens.end()) {
@@ -235,7 +235,7 @@ std::shared_ptr<const Expression> accept_expression
 	// ;
 	accept_token(tokens, current, Token::SEMICOLON);
 
-	return std::static_pointer_cast<const Expression>(result);
+	return static_reference_cast<const Expression>(result);
 
 }
 
@@ -243,11 +243,11 @@ std::shared_ptr<const Expression> accept_expression
 /**
  * Same vein: expect an Expression and cry if your expectations aren't met.
  */
-std::shared_ptr<const Expression> expect_expression
+Reference<const Expression> expect_expression
 	(const std::list<Token>& tokens,
 	std::list<Token>::const_iterator& current) {
 
-	std::shared_ptr<const Expression> expression =
+	Reference<const Expression> expression =
 		accept_expression(tokens, current);
 
 	if (!expression) {
@@ -362,11 +362,11 @@ void expect_balanced(const std::list<Token>& tokens) {
  *
  * Which, as awesome as it is, it really shouldn't be.
  */
-std::shared_ptr<const Expression> Parser::run(const Context& context) const {
+Reference<const Expression> Parser::run(const Context& context) const {
 
 	std::list<Token> tokens = scanner.run(context);
 	std::list<Token>::const_iterator current = tokens.begin();
-	std::shared_ptr<Block> expressions(new Block(0, 0));
+	Reference<Block> expressions(new Block(0, 0));
 
 	expect_balanced(tokens);
 
@@ -389,7 +389,7 @@ std::shared_ptr<const Expression> Parser::run(const Context& context) const {
 
 	try {
 
-		while (std::shared_ptr<const Expression> expression =
+		while (Reference<const Expression> expression =
 			accept_expression(tokens, current))
 			expressions->add(expression);
 
@@ -410,6 +410,6 @@ std::shared_ptr<const Expression> Parser::run(const Context& context) const {
 
 	}
 
-	return std::static_pointer_cast<const Expression>(expressions);
+	return static_reference_cast<const Expression>(expressions);
 
 }
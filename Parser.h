@@ -1,6 +1,6 @@
 #ifndef PARSER_H
 #define PARSER_H
-#include <memory>
+#include "Reference.h"
 
 
 class Context;
@@ -15,7 +15,7 @@ class Parser {
 public:
 
 	Parser(const Scanner&);
-	std::shared_ptr<const Expression> run(const Context&) const;
+	Reference<const Expression> run(const Context&) const;
 
 private:
 
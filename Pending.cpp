@@ -0,0 +1,54 @@
+#include "Pending.h"
+#include "Content.h"
+#include "List.h"
+#include <sstream>
+#include <stdexcept>
+
+
+Pending::Pending(int line, int column, std::shared_ptr<Scheduler> scheduler,
+	Scheduler::Job job) : Value(line, column), scheduler(scheduler),
+	job(job) {}
+
+
+Pending::~Pending() {}
+
+
+Reference<const List> Pending::evaluate(Context&) const {
+	Reference<List> result(new List(line_number, column_number));
+	result->add(self_reference());
+	return static_reference_cast<const List>(result);
+}
+
+
+/**
+ * Wait for the output. By now we're well outside the extern expression that
+ * started the command, so any error gets its location put back on.
+ */
+std::string Pending::get_content() const try {
+
+	return scheduler->wait(job);
+
+} catch (const std::runtime_error& exception) {
+
+	std::ostringstream message;
+	message << "In extern expression at line " << line_number << ", column "
+		<< column_number << ":\n" << exception.what();
+	throw std::runtime_error(message.str());
+
+}
+
+
+double Pending::get_data() const {
+	return Content(line_number, column_number, get_content()).get_data();
+}
+
+
+/**
+ * An image has no business holding running processes, so write the output.
+ */
+void Pending::write(Image& image) const {
+	Content(line_number, column_number, get_content()).write(image);
+}
+
+
+Pending* Pending::clone() const { return new Pending(*this); }
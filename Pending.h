@@ -0,0 +1,37 @@
+#ifndef PENDING_H
+#define PENDING_H
+#include "Scheduler.h"
+#include "Value.h"
+#include <memory>
+#include <string>
+
+
+/**
+ * A string Value that isn't here yet: the output of an external command that
+ * is still running. Evaluation carries on around it, and it only blocks when
+ * something finally asks for its content.
+ */
+class Pending : public Value {
+public:
+
+	Pending(int, int, std::shared_ptr<Scheduler>, Scheduler::Job);
+	virtual ~Pending();
+
+	virtual Reference<const List> evaluate(Context&) const;
+	virtual std::string get_content() const;
+	virtual double get_data() const;
+	virtual void write(Image&) const;
+
+protected:
+
+	virtual Pending* clone() const;
+
+private:
+
+	std::shared_ptr<Scheduler> scheduler;
+	Scheduler::Job job;
+
+};
+
+
+#endif
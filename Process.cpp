@@ -0,0 +1,340 @@
+#include "Process.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+extern char** environ;
+
+
+namespace {
+
+	/**
+	 * Close a descriptor, if it's open, and mark it closed.
+	 */
+	void close_pipe(int& descriptor) {
+		if (descriptor == -1) return;
+		close(descriptor);
+		descriptor = -1;
+	}
+
+	/**
+	 * Write to a pipe without being killed when the reader has gone away.
+	 * SIGPIPE is blocked only for the duration of the write, and a signal
+	 * raised by it is consumed before it can be delivered.
+	 */
+	ssize_t write_pipe(int descriptor, const char* data, std::size_t size) {
+		sigset_t pipe_signal;
+		sigset_t previous;
+		sigemptyset(&pipe_signal);
+		sigaddset(&pipe_signal, SIGPIPE);
+		sigprocmask(SIG_BLOCK, &pipe_signal, &previous);
+		const ssize_t result = write(descriptor, data, size);
+		if (result == -1 && errno == EPIPE) {
+			const timespec immediately = {0, 0};
+			sigtimedwait(&pipe_signal, nullptr, &immediately);
+			errno = EPIPE;
+		}
+		sigprocmask(SIG_SETMASK, &previous, nullptr);
+		return result;
+	}
+
+	const std::size_t chunk_size = 1 << 16;
+
+}
+
+
+/**
+ * Start a program with the given arguments, looked up in the PATH if need be,
+ * which will be fed the given input. The child gets the write end of our
+ * output pipe and the read end of our input pipe; everything else we have open
+ * is closed on exec, so that concurrent children can't hold each other's pipes
+ * open.
+ */
+Process::Process(const std::vector<std::string>& arguments,
+	const std::string& input) : pid(-1), status(-1), input_pipe(-1),
+	output_pipe(-1), input(input), written(0) {
+
+	if (arguments.empty() || arguments.front().empty())
+		throw std::runtime_error("Empty external command.");
+
+	int to_child[2];
+	int from_child[2];
+	if (pipe2(to_child, O_CLOEXEC) != 0)
+		throw std::runtime_error("Unable to create pipe.");
+	if (pipe2(from_child, O_CLOEXEC) != 0) {
+		close(to_child[0]);
+		close(to_child[1]);
+		throw std::runtime_error("Unable to create pipe.");
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+
+	sigset_t no_signals;
+	sigset_t pipe_signal;
+	sigemptyset(&no_signals);
+	sigemptyset(&pipe_signal);
+	sigaddset(&pipe_signal, SIGPIPE);
+
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	posix_spawnattr_setsigmask(&attributes, &no_signals);
+	posix_spawnattr_setsigdefault(&attributes, &pipe_signal);
+	posix_spawnattr_setflags(&attributes,
+		POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	std::vector<char*> argv;
+	for (auto i = arguments.begin(); i != arguments.end(); ++i)
+		argv.push_back(const_cast<char*>(i->c_str()));
+	argv.push_back(nullptr);
+
+	const int error = posix_spawnp(&pid, argv[0], &actions, &attributes,
+		&argv[0], environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attributes);
+	close(to_child[0]);
+	close(from_child[1]);
+
+	if (error != 0) {
+		close(to_child[1]);
+		close(from_child[0]);
+		pid = -1;
+		std::ostringstream message;
+		message << "Unable to run \"" << arguments.front() << "\": "
+			<< std::strerror(error) << ".";
+		throw std::runtime_error(message.str());
+	}
+
+	input_pipe = to_child[1];
+	output_pipe = from_child[0];
+	fcntl(input_pipe, F_SETFL, fcntl(input_pipe, F_GETFL) | O_NONBLOCK);
+	fcntl(output_pipe, F_SETFL, fcntl(output_pipe, F_GETFL) | O_NONBLOCK);
+
+	if (this->input.empty())
+		close_pipe(input_pipe);
+
+}
+
+
+/**
+ * A Process abandoned halfway gets its pipes closed, which ought to persuade
+ * it to finish up, and is then reaped so as not to leave a zombie behind.
+ */
+Process::~Process() {
+	close_pipe(input_pipe);
+	close_pipe(output_pipe);
+	finish();
+}
+
+
+/**
+ * Feed the Process all of its input and collect all of its output.
+ */
+void Process::wait() {
+	const std::vector<Process*> self{this};
+	while (!done())
+		pump(self);
+	finish();
+}
+
+
+/**
+ * Wait until at least one of several Processes can make progress, then move
+ * whatever data is ready for all of them. Any that have finished are reaped.
+ */
+void Process::pump(const std::vector<Process*>& processes) {
+
+	std::vector<pollfd> descriptors(processes.size() * 2);
+	std::vector<int> counts;
+	int total = 0;
+
+	for (auto i = processes.begin(); i != processes.end(); ++i) {
+		counts.push_back((*i)->prepare(&descriptors[total]));
+		total += counts.back();
+	}
+
+	if (total == 0) return;
+
+	if (poll(&descriptors[0], total, -1) == -1) {
+		if (errno == EINTR) return;
+		throw std::runtime_error("Unable to wait for external command.");
+	}
+
+	total = 0;
+	for (std::size_t i = 0; i < processes.size(); ++i) {
+		processes[i]->transfer(&descriptors[total], counts[i]);
+		total += counts[i];
+		if (processes[i]->done())
+			processes[i]->finish();
+	}
+
+}
+
+
+/**
+ * Fill in the descriptors to wait on; return how many there are.
+ */
+int Process::prepare(pollfd* descriptors) const {
+	int count = 0;
+	if (input_pipe != -1) {
+		descriptors[count].fd = input_pipe;
+		descriptors[count].events = POLLOUT;
+		descriptors[count++].revents = 0;
+	}
+	if (output_pipe != -1) {
+		descriptors[count].fd = output_pipe;
+		descriptors[count].events = POLLIN;
+		descriptors[count++].revents = 0;
+	}
+	return count;
+}
+
+
+/**
+ * Move as much data as the pipes will take without blocking. Output is read
+ * in large chunks until the pipe runs dry; input is written a chunk at a time
+ * and closed once it's all gone, or as soon as the child stops listening.
+ */
+void Process::transfer(const pollfd* descriptors, int count) {
+
+	for (int i = 0; i < count; ++i) {
+
+		if (!descriptors[i].revents) continue;
+
+		if (descriptors[i].fd == input_pipe) {
+
+			const std::size_t size =
+				std::min(chunk_size, input.size() - written);
+			const ssize_t result =
+				write_pipe(input_pipe, input.data() + written, size);
+			if (result > 0)
+				written += result;
+			else if (result == -1 && errno != EAGAIN && errno != EINTR)
+				written = input.size();
+			if (written == input.size())
+				close_pipe(input_pipe);
+
+		} else if (descriptors[i].fd == output_pipe) {
+
+			char buffer[chunk_size];
+			while (true) {
+				const ssize_t result = read(output_pipe, buffer, chunk_size);
+				if (result > 0) {
+					output.append(buffer, result);
+				} else if (result == -1 && errno == EINTR) {
+					continue;
+				} else {
+					if (result == 0 || errno != EAGAIN)
+						close_pipe(output_pipe);
+					break;
+				}
+			}
+
+		}
+
+	}
+
+}
+
+
+/**
+ * Reap the child.
+ */
+void Process::finish() {
+	if (pid == -1) return;
+	while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {}
+	pid = -1;
+}
+
+
+/**
+ * Whether the Process has been reaped and exited with a status of zero.
+ */
+bool Process::succeeded() const {
+	return pid == -1 && status != -1 && WIFEXITED(status)
+		&& WEXITSTATUS(status) == 0;
+}
+
+
+/**
+ * Run a command line through the shell, as popen() would.
+ */
+std::vector<std::string> Process::shell(const std::string& command) {
+	return {"/bin/sh", "-c", command};
+}
+
+
+/**
+ * Split a command line into arguments for running it without the shell.
+ * Arguments are separated by whitespace; single quotes preserve everything up
+ * to the next single quote, double quotes preserve everything but backslash
+ * escapes, and a backslash elsewhere preserves the next character. Nothing is
+ * expanded, globbed, or redirected.
+ */
+std::vector<std::string> Process::split(const std::string& command) {
+
+	std::vector<std::string> result;
+	std::string argument;
+	bool started = false;
+
+	for (auto i = command.begin(); i != command.end(); ++i) {
+
+		if (*i == ' ' || *i == '\t' || *i == '\n' || *i == '\r') {
+
+			if (started) result.push_back(argument);
+			argument.clear();
+			started = false;
+
+		} else if (*i == '\'') {
+
+			started = true;
+			while (++i != command.end() && *i != '\'')
+				argument += *i;
+			if (i == command.end())
+				throw std::runtime_error
+					("Unterminated single quote in external command.");
+
+		} else if (*i == '"') {
+
+			started = true;
+			while (++i != command.end() && *i != '"') {
+				if (*i == '\\' && i + 1 != command.end() &&
+					(i[1] == '"' || i[1] == '\\'))
+					++i;
+				argument += *i;
+			}
+			if (i == command.end())
+				throw std::runtime_error
+					("Unterminated double quote in external command.");
+
+		} else if (*i == '\\') {
+
+			started = true;
+			if (++i == command.end()) break;
+			argument += *i;
+
+		} else {
+
+			started = true;
+			argument += *i;
+
+		}
+
+	}
+
+	if (started) result.push_back(argument);
+	return result;
+
+}
@@ -0,0 +1,53 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+
+struct pollfd;
+
+
+/**
+ * A child process with its standard input and output connected to pipes. The
+ * input is written and the output read as each becomes ready, so a program
+ * that produces output before it has consumed all of its input can't
+ * deadlock against us, however much of either there is.
+ */
+class Process {
+public:
+
+	Process(const std::vector<std::string>&, const std::string&);
+	~Process();
+
+	void wait();
+	bool done() const { return input_pipe == -1 && output_pipe == -1; }
+	bool succeeded() const;
+	const std::string& get_output() const { return output; }
+
+	static void pump(const std::vector<Process*>&);
+
+	static std::vector<std::string> shell(const std::string&);
+	static std::vector<std::string> split(const std::string&);
+
+private:
+
+	Process(const Process&) = delete;
+	Process& operator=(const Process&) = delete;
+
+	int prepare(pollfd*) const;
+	void transfer(const pollfd*, int);
+	void finish();
+
+	pid_t pid;
+	int status;
+	int input_pipe;
+	int output_pipe;
+	std::string input;
+	std::string::size_type written;
+	std::string output;
+
+};
+
+
+#endif
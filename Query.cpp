@@ -0,0 +1,144 @@
+#include "Query.h"
+#include "Content.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+	/**
+	 * Find the first character that needs decoding, sixteen at a time where
+	 * the hardware allows, so that plain runs can be copied in one go.
+	 */
+	std::size_t plain_run(const char* data, std::size_t size) {
+		std::size_t i = 0;
+#ifdef __SSE2__
+		const __m128i percent = _mm_set1_epi8('%');
+		const __m128i plus = _mm_set1_epi8('+');
+		for (; i + 16 <= size; i += 16) {
+			const __m128i chunk = _mm_loadu_si128
+				(reinterpret_cast<const __m128i*>(data + i));
+			const int mask = _mm_movemask_epi8(_mm_or_si128
+				(_mm_cmpeq_epi8(chunk, percent), _mm_cmpeq_epi8(chunk, plus)));
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+#endif
+		for (; i < size; ++i)
+			if (data[i] == '%' || data[i] == '+')
+				return i;
+		return size;
+	}
+
+	int hex_value(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 0xa;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 0xa;
+		return -1;
+	}
+
+}
+
+
+Query::Query(const std::string& raw,
+	std::string (*escape)(const std::string&)) :
+	raw(raw), escape(escape), indexed(false) {}
+
+
+/**
+ * Decode a URL-encoded string. A percent sign that isn't followed by two hex
+ * digits is taken literally.
+ */
+std::string Query::decode(const char* data, std::size_t size) {
+
+	std::string result;
+	result.reserve(size);
+
+	std::size_t i = 0;
+	while (i < size) {
+
+		const std::size_t run = plain_run(data + i, size - i);
+		result.append(data + i, run);
+		i += run;
+		if (i == size) break;
+
+		if (data[i] == '+') {
+			result += ' ';
+			++i;
+			continue;
+		}
+
+		const int upper = i + 2 < size ? hex_value(data[i + 1]) : -1;
+		const int lower = upper != -1 ? hex_value(data[i + 2]) : -1;
+		if (lower != -1) {
+			result += char(upper << 4 | lower);
+			i += 3;
+		} else {
+			result += '%';
+			++i;
+		}
+
+	}
+
+	return result;
+
+}
+
+
+/**
+ * Look up a name, decoding its value the first time. When a name appears more
+ * than once, the last one wins.
+ */
+Reference<const Expression> Query::operator()(Symbol name) {
+
+	auto cached = decoded.find(name);
+	if (cached != decoded.end())
+		return cached->second;
+
+	if (!indexed) index();
+
+	auto position = values.find(name.string());
+	if (position == values.end())
+		return Reference<const Expression>();
+
+	std::string value = decode(raw.data() + position->second.first,
+		position->second.second);
+	if (escape) value = escape(value);
+	Reference<const Expression> result(new Content(0, 0, value));
+	decoded.insert({name, result});
+	return result;
+
+}
+
+
+/**
+ * Record where each value is, by decoded name. Names are rarely encoded, so
+ * they're only decoded when they need to be.
+ */
+void Query::index() {
+
+	indexed = true;
+	std::size_t begin = 0;
+
+	while (begin < raw.size()) {
+
+		std::size_t end = raw.find('&', begin);
+		if (end == std::string::npos) end = raw.size();
+
+		std::size_t equals = raw.find('=', begin);
+		if (equals == std::string::npos || equals > end) equals = end;
+
+		if (equals != begin) {
+			const char* name = raw.data() + begin;
+			const std::size_t size = equals - begin;
+			const std::size_t value = equals == end ? end : equals + 1;
+			values[plain_run(name, size) == size ? std::string(name, size) :
+				decode(name, size)] = {value, end - value};
+		}
+
+		begin = end + 1;
+
+	}
+
+}
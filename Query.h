@@ -0,0 +1,46 @@
+#ifndef QUERY_H
+#define QUERY_H
+#include "Expression.h"
+#include "Reference.h"
+#include "Symbol.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+
+/**
+ * An application/x-www-form-urlencoded query, as from QUERY_STRING or a POST
+ * body, kept in its raw form. Nothing is decoded until a name is looked up,
+ * at which point the names are indexed, once, and just the one value wanted
+ * is decoded and made into Content, escaped first if there's an escape
+ * function. Serves as a Context::Provider.
+ */
+class Query {
+public:
+
+	explicit Query(const std::string&,
+		std::string (*)(const std::string&) = nullptr);
+
+	Reference<const Expression> operator()(Symbol);
+
+	static std::string decode(const char*, std::size_t);
+	static std::string decode(const std::string& encoded) {
+		return decode(encoded.data(), encoded.size());
+	}
+
+private:
+
+	void index();
+
+	std::string raw;
+	std::string (*escape)(const std::string&);
+	bool indexed;
+	std::unordered_map<std::string, std::pair<std::size_t, std::size_t>>
+		values;
+	std::unordered_map<Symbol, Reference<const Expression>> decoded;
+
+};
+
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+#include <cstddef>
+#include <utility>
+#ifdef VISION_ATOMIC_REFERENCES
+#include <atomic>
+#endif
+
+
+/**
+ * A base for objects that keep count of their own References. Evaluation is
+ * single-threaded, so by default the count is a plain integer; a host that
+ * shares trees between threads can build with VISION_ATOMIC_REFERENCES to get
+ * an atomic count instead. Copies start out unreferenced, since a reference
+ * count belongs to an object and not to its value.
+ */
+class Counted {
+public:
+
+	Counted() : references(0) {}
+	Counted(const Counted&) : references(0) {}
+	Counted& operator=(const Counted&) { return *this; }
+
+	void retain() const {
+#ifdef VISION_ATOMIC_REFERENCES
+		references.fetch_add(1, std::memory_order_relaxed);
+#else
+		++references;
+#endif
+	}
+
+	bool release() const {
+#ifdef VISION_ATOMIC_REFERENCES
+		return references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#else
+		return --references == 0;
+#endif
+	}
+
+	bool referenced() const { return references != 0; }
+
+protected:
+
+	~Counted() {}
+
+private:
+
+#ifdef VISION_ATOMIC_REFERENCES
+	mutable std::atomic<long> references;
+#else
+	mutable long references;
+#endif
+
+};
+
+
+/**
+ * A reference to a Counted object. Behaves like std::shared_ptr, except that
+ * the count lives in the object itself, so copying a Reference costs a single
+ * increment and needs no separate control block.
+ */
+template<class T>
+class Reference {
+public:
+
+	Reference() : pointer(nullptr) {}
+	Reference(std::nullptr_t) : pointer(nullptr) {}
+
+	explicit Reference(T* pointer) : pointer(pointer) {
+		if (pointer) pointer->retain();
+	}
+
+	Reference(const Reference& other) : pointer(other.pointer) {
+		if (pointer) pointer->retain();
+	}
+
+	Reference(Reference&& other) : pointer(other.pointer) {
+		other.pointer = nullptr;
+	}
+
+	template<class U>
+	Reference(const Reference<U>& other) : pointer(other.get()) {
+		if (pointer) pointer->retain();
+	}
+
+	~Reference() { if (pointer && pointer->release()) delete pointer; }
+
+	Reference& operator=(Reference other) {
+		std::swap(pointer, other.pointer);
+		return *this;
+	}
+
+	void reset(T* other = nullptr) { Reference(other).swap(*this); }
+	void swap(Reference& other) { std::swap(pointer, other.pointer); }
+
+	T* get() const { return pointer; }
+	T& operator*() const { return *pointer; }
+	T* operator->() const { return pointer; }
+	explicit operator bool() const { return pointer != nullptr; }
+
+private:
+
+	T* pointer;
+
+};
+
+
+template<class T, class U>
+bool operator==(const Reference<T>& a, const Reference<U>& b) {
+	return a.get() == b.get();
+}
+
+
+template<class T, class U>
+bool operator!=(const Reference<T>& a, const Reference<U>& b) {
+	return a.get() != b.get();
+}
+
+
+template<class T, class U>
+Reference<T> static_reference_cast(const Reference<U>& reference) {
+	return Reference<T>(static_cast<T*>(reference.get()));
+}
+
+
+template<class T, class U>
+Reference<T> dynamic_reference_cast(const Reference<U>& reference) {
+	return Reference<T>(dynamic_cast<T*>(reference.get()));
+}
+
+
+#endif
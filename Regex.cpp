@@ -0,0 +1,969 @@
+#include "Regex.h"
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+
+namespace {
+
+	/**
+	 * How many compiled patterns to keep around for reuse. A template tends to
+	 * use a handful of patterns over and over, often once per row of a table,
+	 * so this only needs to be big enough that they don't push each other out.
+	 */
+	const std::size_t cache_size = 64;
+
+	/**
+	 * Limits on counted repetition and on the size of the compiled program,
+	 * because "(a{1000}){1000}" is a short pattern but a very long program,
+	 * on groups, because every thread carries the positions of them all, and
+	 * on how deeply they nest, because parsing and compiling them recurse.
+	 */
+	const int repetition_limit = 1000;
+	const std::size_t program_limit = 1 << 16;
+	const std::size_t group_limit = 100;
+	const int depth_limit = 1000;
+
+	bool is_word(unsigned char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+			|| (c >= '0' && c <= '9') || c == '_';
+	}
+
+	bool is_digit(unsigned char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	bool is_space(unsigned char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'
+			|| c == '\v';
+	}
+
+	/**
+	 * The length of the UTF-8 sequence that a byte starts, or one if it can't
+	 * start one.
+	 */
+	std::size_t sequence_length(unsigned char lead) {
+		if (lead >= 0xc2 && lead <= 0xdf) return 2;
+		if (lead >= 0xe0 && lead <= 0xef) return 3;
+		if (lead >= 0xf0 && lead <= 0xf4) return 4;
+		return 1;
+	}
+
+	/**
+	 * The threads at one position in the text, in order of priority, each
+	 * with its own copy of the group positions. The set is sparse, so that
+	 * clearing it and checking it are both constant time.
+	 */
+	class Queue {
+	public:
+
+		Queue(std::size_t size, std::size_t slots) :
+			sparse(size), slots(slots), captures(size * slots) {
+			dense.reserve(size);
+		}
+
+		bool contains(int pc) const {
+			return sparse[pc] < dense.size() && dense[sparse[pc]] == pc;
+		}
+
+		void insert(int pc) {
+			sparse[pc] = dense.size();
+			dense.push_back(pc);
+		}
+
+		std::size_t* at(int pc) { return &captures[pc * slots]; }
+
+		bool empty() const { return dense.empty(); }
+		void clear() { dense.clear(); }
+
+		std::vector<int> dense;
+
+	private:
+
+		std::vector<std::size_t> sparse;
+		std::size_t slots;
+		std::vector<std::size_t> captures;
+
+	};
+
+	/**
+	 * An instruction still to follow, or a saved position to put back.
+	 */
+	struct Entry {
+		int pc;
+		std::size_t slot;
+		std::size_t value;
+	};
+
+}
+
+
+/**
+ * Everything a run of the program needs besides the text, which is sized for
+ * the program and so can be reused from one search to the next.
+ */
+struct Regex::Threads {
+
+	Threads(std::size_t size, std::size_t slots) : current(size, slots),
+		next(size, slots), working(slots) {}
+
+	Queue current;
+	Queue next;
+	std::vector<std::size_t> working;
+	std::vector<Entry> stack;
+
+};
+
+
+struct Regex::Node {
+
+	enum Kind {
+		EMPTY,
+		BYTE,
+		CLASS,
+		BEGIN,
+		END,
+		BOUNDARY,
+		NOT_BOUNDARY,
+		GROUP,
+		CONCATENATION,
+		ALTERNATION,
+		REPETITION,
+	};
+
+	explicit Node(Kind kind, int value = 0) : kind(kind), value(value),
+		minimum(0), maximum(0), greedy(true) {}
+
+	bool nullable() const;
+
+	Kind kind;
+	int value;
+	int minimum;
+	int maximum;
+	bool greedy;
+	std::vector<Node> children;
+
+};
+
+
+/**
+ * Whether this can match without consuming anything.
+ */
+bool Regex::Node::nullable() const {
+	switch (kind) {
+	case BYTE:
+	case CLASS:
+		return false;
+	case GROUP:
+		return children.front().nullable();
+	case CONCATENATION:
+		for (auto i = children.begin(); i != children.end(); ++i)
+			if (!i->nullable()) return false;
+		return true;
+	case ALTERNATION:
+		for (auto i = children.begin(); i != children.end(); ++i)
+			if (i->nullable()) return true;
+		return false;
+	case REPETITION:
+		return minimum == 0 || children.front().nullable();
+	default:
+		return true;
+	}
+}
+
+
+/**
+ * A recursive descent parser for patterns, from the loosest binding operator,
+ * "|", down to single characters.
+ */
+class Regex::Parser {
+public:
+
+	Parser(const std::string& pattern, Regex& regex) :
+		pattern(pattern), position(0), depth(0), regex(regex) {}
+
+	Node parse() {
+		Node result = alternation();
+		if (position != pattern.size())
+			fail("unmatched \")\"");
+		return result;
+	}
+
+private:
+
+	Node alternation();
+	Node concatenation();
+	Node repetition();
+	Node atom();
+	Node bracket();
+	Node escape();
+	Node character();
+	Node any_sequence();
+	Node byte_class(const std::vector<bool>&);
+	Node set(const std::vector<bool>&, bool, const std::vector<Node>&);
+	bool quantifier(int&, int&);
+	int number();
+	[[noreturn]] void fail(const std::string&) const;
+
+	bool more() const { return position < pattern.size(); }
+	char peek() const { return pattern[position]; }
+
+	const std::string& pattern;
+	std::size_t position;
+	int depth;
+	Regex& regex;
+
+};
+
+
+void Regex::Parser::fail(const std::string& reason) const {
+	throw std::runtime_error("Invalid regular expression \"" + pattern
+		+ "\": " + reason + ".");
+}
+
+
+Regex::Node Regex::Parser::alternation() {
+	Node first = concatenation();
+	if (!more() || peek() != '|') return first;
+	Node result(Node::ALTERNATION);
+	result.children.push_back(first);
+	while (more() && peek() == '|') {
+		++position;
+		result.children.push_back(concatenation());
+	}
+	return result;
+}
+
+
+Regex::Node Regex::Parser::concatenation() {
+	Node result(Node::CONCATENATION);
+	while (more() && peek() != '|' && peek() != ')')
+		result.children.push_back(repetition());
+	return result;
+}
+
+
+/**
+ * An atom and at most one quantifier. Another straight after, as in "a*+" or
+ * "a{2}{3}", is refused rather than taken to repeat the repetition, since in
+ * Perl it would mean something else.
+ */
+Regex::Node Regex::Parser::repetition() {
+	Node child = atom();
+	int minimum;
+	int maximum;
+	if (!more() || !quantifier(minimum, maximum)) return child;
+	Node result(Node::REPETITION);
+	result.minimum = minimum;
+	result.maximum = maximum;
+	if (more() && peek() == '?') {
+		result.greedy = false;
+		++position;
+	}
+	result.children.push_back(child);
+	if (more() && quantifier(minimum, maximum))
+		fail("nothing to repeat");
+	return result;
+}
+
+
+/**
+ * Read a quantifier, if there is one. A brace that doesn't start a valid
+ * count is just a brace.
+ */
+bool Regex::Parser::quantifier(int& minimum, int& maximum) {
+
+	switch (peek()) {
+	case '*': minimum = 0; maximum = -1; ++position; return true;
+	case '+': minimum = 1; maximum = -1; ++position; return true;
+	case '?': minimum = 0; maximum = 1;  ++position; return true;
+	case '{': break;
+	default: return false;
+	}
+
+	const std::size_t start = position++;
+	if (!more() || !is_digit(peek())) {
+		position = start;
+		return false;
+	}
+	minimum = maximum = number();
+	if (more() && peek() == ',') {
+		++position;
+		maximum = more() && is_digit(peek()) ? number() : -1;
+	}
+	if (!more() || peek() != '}') {
+		position = start;
+		return false;
+	}
+	++position;
+
+	if (minimum > repetition_limit || maximum > repetition_limit)
+		fail("repetition count is too large");
+	if (maximum != -1 && maximum < minimum)
+		fail("repetition count is out of order");
+	return true;
+
+}
+
+
+int Regex::Parser::number() {
+	int result = 0;
+	while (more() && is_digit(peek()) && result <= repetition_limit)
+		result = result * 10 + (pattern[position++] - '0');
+	return result;
+}
+
+
+Regex::Node Regex::Parser::atom() {
+
+	switch (peek()) {
+
+	case '(':
+		{
+			++position;
+			if (++depth > depth_limit)
+				fail("groups are nested too deeply");
+			Node result(Node::GROUP);
+			if (pattern.compare(position, 2, "?:") == 0) {
+				position += 2;
+				result = alternation();
+			} else {
+				if (regex.group_count == group_limit)
+					fail("too many groups");
+				result.value = ++regex.group_count;
+				result.children.push_back(alternation());
+			}
+			if (!more() || peek() != ')')
+				fail("unmatched \"(\"");
+			++position;
+			--depth;
+			return result;
+		}
+
+	case '*':
+	case '+':
+	case '?':
+		fail("nothing to repeat");
+
+	case '[':
+		++position;
+		return bracket();
+
+	case '.':
+		{
+			++position;
+			std::vector<bool> bytes(128, true);
+			bytes['\n'] = false;
+			return set(bytes, true, std::vector<Node>());
+		}
+
+	case '^':
+		++position;
+		return Node(Node::BEGIN);
+
+	case '$':
+		++position;
+		return Node(Node::END);
+
+	case '\\':
+		++position;
+		return escape();
+
+	default:
+		return character();
+
+	}
+
+}
+
+
+/**
+ * A single character, which may be several bytes long.
+ */
+Regex::Node Regex::Parser::character() {
+	const std::size_t length =
+		sequence_length(static_cast<unsigned char>(peek()));
+	if (length == 1 || position + length > pattern.size())
+		return Node(Node::BYTE,
+			static_cast<unsigned char>(pattern[position++]));
+	Node result(Node::CONCATENATION);
+	for (std::size_t i = 0; i < length; ++i)
+		result.children.push_back(Node(Node::BYTE,
+			static_cast<unsigned char>(pattern[position++])));
+	return result;
+}
+
+
+Regex::Node Regex::Parser::escape() {
+
+	if (!more()) fail("trailing backslash");
+	const char c = pattern[position++];
+
+	switch (c) {
+	case 'b': return Node(Node::BOUNDARY);
+	case 'B': return Node(Node::NOT_BOUNDARY);
+	case 'n': return Node(Node::BYTE, '\n');
+	case 'r': return Node(Node::BYTE, '\r');
+	case 't': return Node(Node::BYTE, '\t');
+	case 'f': return Node(Node::BYTE, '\f');
+	case 'v': return Node(Node::BYTE, '\v');
+	}
+
+	std::vector<bool> bytes(128, false);
+	bool (*test)(unsigned char) = nullptr;
+	switch (c) {
+	case 'd': case 'D': test = is_digit; break;
+	case 'w': case 'W': test = is_word; break;
+	case 's': case 'S': test = is_space; break;
+	}
+	if (test) {
+		const bool negated = c < 'a';
+		for (int i = 0; i < 128; ++i)
+			bytes[i] = test(i) != negated;
+		return set(bytes, negated, std::vector<Node>());
+	}
+
+	if (is_digit(c))
+		fail("backreferences aren't supported");
+	if (is_word(c))
+		fail(std::string("unknown escape \"\\") + c + "\"");
+	--position;
+	return character();
+
+}
+
+
+/**
+ * A bracketed class such as "[a-z_]" or "[^,]", after the opening bracket.
+ */
+Regex::Node Regex::Parser::bracket() {
+
+	bool negated = false;
+	if (more() && peek() == '^') {
+		negated = true;
+		++position;
+	}
+
+	std::vector<bool> bytes(128, false);
+	bool other = false;
+	std::vector<Node> characters;
+	bool first = true;
+
+	while (true) {
+
+		if (!more()) fail("unmatched \"[\"");
+		unsigned char c = pattern[position];
+		if (c == ']' && !first) break;
+		first = false;
+
+		if (c == '\\' && position + 1 < pattern.size()
+			&& static_cast<unsigned char>(pattern[position + 1]) >= 0x80)
+			c = pattern[++position];
+
+		if (c == '\\' && position + 1 < pattern.size()) {
+			const char escaped = pattern[position + 1];
+			bool (*test)(unsigned char) = nullptr;
+			switch (escaped) {
+			case 'd': case 'D': test = is_digit; break;
+			case 'w': case 'W': test = is_word; break;
+			case 's': case 'S': test = is_space; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			case 'f': c = '\f'; break;
+			case 'v': c = '\v'; break;
+			default: c = escaped; break;
+			}
+			position += 2;
+			if (test) {
+				const bool complement = escaped < 'a';
+				for (int i = 0; i < 128; ++i)
+					if (test(i) != complement) bytes[i] = true;
+				if (complement) other = true;
+				continue;
+			}
+		} else if (c >= 0x80) {
+			characters.push_back(character());
+			if (more() && peek() == '-' && position + 1 < pattern.size()
+				&& pattern[position + 1] != ']')
+				fail("ranges of non-ASCII characters aren't supported");
+			continue;
+		} else {
+			++position;
+		}
+
+		unsigned char last = c;
+		if (more() && peek() == '-' && position + 1 < pattern.size()
+			&& pattern[position + 1] != ']') {
+			last = pattern[position + 1];
+			position += 2;
+			if (last == '\\' && more()) last = pattern[position++];
+			if (last >= 0x80)
+				fail("ranges of non-ASCII characters aren't supported");
+			if (last < c)
+				fail("character range is out of order");
+		}
+		for (unsigned int i = c; i <= last; ++i)
+			bytes[i] = true;
+
+	}
+	++position;
+
+	if (negated) {
+		if (!characters.empty())
+			fail("negated classes of non-ASCII characters aren't supported");
+		for (int i = 0; i < 128; ++i)
+			bytes[i] = !bytes[i];
+		other = !other;
+	}
+	return set(bytes, other, characters);
+
+}
+
+
+/**
+ * A set of characters: some ASCII, then either every other character or some
+ * particular ones.
+ */
+Regex::Node Regex::Parser::set(const std::vector<bool>& ascii, bool other,
+	const std::vector<Node>& characters) {
+
+	Node result(Node::ALTERNATION);
+	std::vector<bool> bytes(256, false);
+	bool any = false;
+	for (int i = 0; i < 128; ++i)
+		if (ascii[i]) bytes[i] = any = true;
+	if (any) result.children.push_back(byte_class(bytes));
+
+	if (other) {
+		result.children.push_back(any_sequence());
+	} else {
+		result.children.insert(result.children.end(), characters.begin(),
+			characters.end());
+	}
+
+	if (result.children.empty())
+		return Node(Node::CLASS, -1);
+	if (result.children.size() == 1)
+		return result.children.front();
+	return result;
+
+}
+
+
+/**
+ * Any well-formed multibyte UTF-8 sequence.
+ */
+Regex::Node Regex::Parser::any_sequence() {
+
+	std::vector<bool> continuation(256, false);
+	for (int i = 0x80; i <= 0xbf; ++i)
+		continuation[i] = true;
+
+	Node result(Node::ALTERNATION);
+	const int leads[][2] = { { 0xc2, 0xdf }, { 0xe0, 0xef }, { 0xf0, 0xf4 } };
+	for (int length = 2; length <= 4; ++length) {
+		std::vector<bool> lead(256, false);
+		for (int i = leads[length - 2][0]; i <= leads[length - 2][1]; ++i)
+			lead[i] = true;
+		Node sequence(Node::CONCATENATION);
+		sequence.children.push_back(byte_class(lead));
+		for (int i = 1; i < length; ++i)
+			sequence.children.push_back(byte_class(continuation));
+		result.children.push_back(sequence);
+	}
+	return result;
+
+}
+
+
+Regex::Node Regex::Parser::byte_class(const std::vector<bool>& bytes) {
+	auto& classes = regex.classes;
+	for (std::size_t i = 0; i < classes.size(); ++i)
+		if (classes[i] == bytes)
+			return Node(Node::CLASS, i);
+	classes.push_back(bytes);
+	return Node(Node::CLASS, classes.size() - 1);
+}
+
+
+/**
+ * Compile a pattern into a program of the form "save the start, match the
+ * pattern, save the end", throwing if the pattern is invalid. Each thread
+ * keeps the start and end of every group, and then the start of the current
+ * iteration of every loop that could go round without consuming anything.
+ */
+Regex::Regex(const std::string& pattern) : group_count(0), slot_count(0),
+	first_byte(-1) {
+
+	Node root = Parser(pattern, *this).parse();
+	slot_count = 2 * (group_count + 1);
+
+	emit(SAVE, 0);
+	generate(root);
+	emit(SAVE, 1);
+	emit(MATCH);
+
+	if (program[1].operation == BYTE)
+		first_byte = program[1].x;
+
+}
+
+
+/**
+ * Get a compiled pattern, compiling it only if it hasn't been used recently.
+ */
+std::shared_ptr<const Regex> Regex::compile(const std::string& pattern) {
+
+	typedef std::list<std::pair<std::string, std::shared_ptr<const Regex>>>
+		Recent;
+	static Recent recent;
+	static std::unordered_map<std::string, Recent::iterator> index;
+
+	const auto existing = index.find(pattern);
+	if (existing != index.end()) {
+		recent.splice(recent.begin(), recent, existing->second);
+		return existing->second->second;
+	}
+
+	const auto result = std::make_shared<const Regex>(pattern);
+	recent.emplace_front(pattern, result);
+	index[pattern] = recent.begin();
+	if (recent.size() > cache_size) {
+		index.erase(recent.back().first);
+		recent.pop_back();
+	}
+	return result;
+
+}
+
+
+int Regex::emit(Operation operation, int x, int y) {
+	if (program.size() >= program_limit)
+		throw std::runtime_error("Regular expression is too large.");
+	program.push_back(Instruction{operation, x, y});
+	return program.size() - 1;
+}
+
+
+void Regex::generate(const Node& node) {
+
+	switch (node.kind) {
+
+	case Node::EMPTY:
+		break;
+
+	case Node::BYTE:
+		emit(BYTE, node.value);
+		break;
+
+	case Node::CLASS:
+		emit(CLASS, node.value);
+		break;
+
+	case Node::BEGIN:
+		emit(BEGIN);
+		break;
+
+	case Node::END:
+		emit(END);
+		break;
+
+	case Node::BOUNDARY:
+		emit(BOUNDARY);
+		break;
+
+	case Node::NOT_BOUNDARY:
+		emit(NOT_BOUNDARY);
+		break;
+
+	case Node::GROUP:
+		emit(SAVE, 2 * node.value);
+		generate(node.children.front());
+		emit(SAVE, 2 * node.value + 1);
+		break;
+
+	case Node::CONCATENATION:
+		for (auto i = node.children.begin(); i != node.children.end(); ++i)
+			generate(*i);
+		break;
+
+	case Node::ALTERNATION:
+		{
+			std::vector<int> jumps;
+			for (std::size_t i = 0; i + 1 < node.children.size(); ++i) {
+				const int split = emit(SPLIT, 0, 0);
+				program[split].x = split + 1;
+				generate(node.children[i]);
+				jumps.push_back(emit(JUMP));
+				program[split].y = program.size();
+			}
+			generate(node.children.back());
+			for (auto i = jumps.begin(); i != jumps.end(); ++i)
+				program[*i].x = program.size();
+			break;
+		}
+
+	case Node::REPETITION:
+		{
+			// As in Perl, an iteration of a loop that matches nothing is
+			// the last, rather than a dead end, so the loop is left with the
+			// priority that the empty iteration had.
+			const Node& child = node.children.front();
+			const int slot = node.maximum == -1 && child.nullable()
+				? slot_count++ : -1;
+			if (node.maximum == -1 && node.minimum > 0) {
+				for (int i = 1; i < node.minimum; ++i)
+					generate(child);
+				const int loop = program.size();
+				if (slot != -1) emit(SAVE, slot);
+				generate(child);
+				if (slot != -1) emit(PROGRESS, slot, program.size() + 2);
+				const int after = program.size() + 1;
+				emit(SPLIT, node.greedy ? loop : after,
+					node.greedy ? after : loop);
+				break;
+			}
+			for (int i = 0; i < node.minimum; ++i)
+				generate(child);
+			if (node.maximum == -1) {
+				const int split = emit(SPLIT);
+				if (slot != -1) emit(SAVE, slot);
+				generate(child);
+				const int progress = slot != -1 ? emit(PROGRESS, slot) : -1;
+				emit(JUMP, split);
+				const int after = program.size();
+				if (progress != -1) program[progress].y = after;
+				program[split].x = node.greedy ? split + 1 : after;
+				program[split].y = node.greedy ? after : split + 1;
+				break;
+			}
+			std::vector<int> splits;
+			for (int i = node.minimum; i < node.maximum; ++i) {
+				splits.push_back(emit(SPLIT));
+				generate(child);
+			}
+			const int after = program.size();
+			for (auto i = splits.begin(); i != splits.end(); ++i) {
+				program[*i].x = node.greedy ? *i + 1 : after;
+				program[*i].y = node.greedy ? after : *i + 1;
+			}
+			break;
+		}
+
+	}
+
+}
+
+
+bool Regex::match(const std::string& text) const {
+	std::vector<std::size_t> groups;
+	Threads threads(program.size(), slot_count);
+	return run(text, 0, true, groups, threads);
+}
+
+
+/**
+ * Find the leftmost match at or after some position, setting the start and
+ * end of the match and then of each group, or npos for a group that didn't
+ * take part.
+ */
+bool Regex::search(const std::string& text, std::size_t from,
+	std::vector<std::size_t>& groups) const {
+	Threads threads(program.size(), slot_count);
+	return run(text, from, false, groups, threads);
+}
+
+
+/**
+ * Run every thread of the program in lockstep over the text, one byte at a
+ * time. A thread is added for a position only once, so there are never more
+ * threads than instructions, and threads are kept in order of priority, so
+ * that when one matches, the ones after it can simply be dropped.
+ */
+bool Regex::run(const std::string& text, std::size_t from, bool whole,
+	std::vector<std::size_t>& groups, Threads& threads) const {
+
+	const std::size_t slots = slot_count;
+	const std::size_t size = text.size();
+	const unsigned char* data =
+		reinterpret_cast<const unsigned char*>(text.data());
+
+	Queue& current = threads.current;
+	Queue& next = threads.next;
+	std::vector<std::size_t>& working = threads.working;
+	std::vector<Entry>& stack = threads.stack;
+	current.clear();
+
+	/**
+	 * Follow the instructions that don't consume anything from some starting
+	 * point, adding a thread for each one that does. Saved positions are
+	 * restored on the way back, as though this were recursive.
+	 */
+	const auto add = [&](Queue& queue, int start, std::size_t position) {
+		stack.push_back(Entry{start, 0, 0});
+		while (!stack.empty()) {
+			const Entry entry = stack.back();
+			stack.pop_back();
+			if (entry.pc == -1) {
+				working[entry.slot] = entry.value;
+				continue;
+			}
+			const int pc = entry.pc;
+			if (queue.contains(pc)) continue;
+			queue.insert(pc);
+			const Instruction& instruction = program[pc];
+			switch (instruction.operation) {
+			case JUMP:
+				stack.push_back(Entry{instruction.x, 0, 0});
+				break;
+			case SPLIT:
+				stack.push_back(Entry{instruction.y, 0, 0});
+				stack.push_back(Entry{instruction.x, 0, 0});
+				break;
+			case SAVE:
+				stack.push_back(Entry{-1, std::size_t(instruction.x),
+					working[instruction.x]});
+				working[instruction.x] = position;
+				stack.push_back(Entry{pc + 1, 0, 0});
+				break;
+			case PROGRESS:
+				stack.push_back(Entry{working[instruction.x] == position
+					? instruction.y : pc + 1, 0, 0});
+				break;
+			case BEGIN:
+				if (position == 0)
+					stack.push_back(Entry{pc + 1, 0, 0});
+				break;
+			case END:
+				if (position == size)
+					stack.push_back(Entry{pc + 1, 0, 0});
+				break;
+			case BOUNDARY:
+			case NOT_BOUNDARY:
+				{
+					const bool before = position > 0
+						&& is_word(data[position - 1]);
+					const bool after = position < size
+						&& is_word(data[position]);
+					const bool wanted = instruction.operation == BOUNDARY;
+					if ((before != after) == wanted)
+						stack.push_back(Entry{pc + 1, 0, 0});
+					break;
+				}
+			default:
+				std::copy(working.begin(), working.end(), queue.at(pc));
+				break;
+			}
+		}
+	};
+
+	bool matched = false;
+	for (std::size_t position = from; ; ++position) {
+
+		if (!matched && (!whole || position == from)) {
+			if (current.empty() && first_byte != -1 && !whole) {
+				const void* found = std::memchr(data + position, first_byte,
+					size - position);
+				if (!found) break;
+				position = static_cast<const unsigned char*>(found) - data;
+			}
+			std::fill(working.begin(), working.end(), std::string::npos);
+			add(current, 0, position);
+		}
+		if (current.empty()) break;
+
+		next.clear();
+		for (auto i = current.dense.begin(); i != current.dense.end(); ++i) {
+			const Instruction& instruction = program[*i];
+			const std::size_t* captures = current.at(*i);
+			if (instruction.operation == MATCH) {
+				if (whole && position != size) continue;
+				matched = true;
+				groups.assign(captures, captures + 2 * (group_count + 1));
+				break;
+			}
+			if (position == size) continue;
+			const unsigned char c = data[position];
+			if (instruction.operation == BYTE ? c == instruction.x
+				: instruction.operation == CLASS && instruction.x != -1
+				&& classes[instruction.x][c]) {
+				std::copy(captures, captures + slots, working.begin());
+				add(next, *i + 1, position + 1);
+			}
+		}
+
+		std::swap(current, next);
+		if (position == size) break;
+
+	}
+
+	return matched;
+
+}
+
+
+/**
+ * Replace every match with a replacement, in which "\1" through "\9" stand
+ * for groups, "\0" for the whole match, and "\\" for a backslash. An empty
+ * match is replaced, and then the character after it is kept as it is, so
+ * that the search always moves forward.
+ */
+std::string Regex::substitute(const std::string& text,
+	const std::string& replacement) const {
+
+	for (std::size_t i = 0; i + 1 < replacement.size(); ++i) {
+		if (replacement[i] != '\\') continue;
+		const char c = replacement[++i];
+		if (is_digit(c) && std::size_t(c - '0') > group_count)
+			throw std::runtime_error("No group " + std::string(1, c)
+				+ " in regular expression.");
+	}
+
+	std::string result;
+	std::vector<std::size_t> groups;
+	Threads threads(program.size(), slot_count);
+	std::size_t position = 0;
+
+	while (position <= text.size()
+		&& run(text, position, false, groups, threads)) {
+
+		if (result.empty()) result.reserve(text.size());
+		result.append(text, position, groups[0] - position);
+
+		for (std::size_t i = 0; i < replacement.size(); ++i) {
+			const char c = replacement[i];
+			if (c != '\\' || i + 1 == replacement.size()) {
+				result += c;
+				continue;
+			}
+			const char escaped = replacement[++i];
+			if (!is_digit(escaped)) {
+				result += escaped;
+				continue;
+			}
+			const std::size_t group = escaped - '0';
+			if (groups[2 * group] != std::string::npos)
+				result.append(text, groups[2 * group],
+					groups[2 * group + 1] - groups[2 * group]);
+		}
+
+		position = groups[1];
+		if (groups[0] == groups[1]) {
+			if (position == text.size()) return result;
+			const std::size_t length = sequence_length
+				(static_cast<unsigned char>(text[position]));
+			result.append(text, position, length);
+			position += length;
+		}
+
+	}
+
+	if (position == 0) return text;
+	result.append(text, position, std::string::npos);
+	return result;
+
+}
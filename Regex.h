@@ -0,0 +1,81 @@
+#ifndef REGEX_H
+#define REGEX_H
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * A compiled regular expression, matched by simulating all of its states at
+ * once (a Pike VM), so that matching takes time linear in the length of the
+ * text whatever the pattern, and never backtracks.
+ *
+ * The syntax is the common core of POSIX extended and Perl syntax: literals,
+ * ".", classes such as "[a-z]" and "[^,]", the escapes \d \w \s and their
+ * negations, "^", "$", \b and \B, groups, "(?:...)", alternation, and the
+ * quantifiers * + ? {m} {m,} {m,n}, each with a lazy variant. Text is UTF-8:
+ * "." and negated classes match whole characters, while \d \w \s and class
+ * ranges are ASCII; a class can list non-ASCII characters, but not ranges of
+ * them. "^" and "$" match only at the ends of the text, and "." doesn't match
+ * a line break. Where more than one match is possible, the leftmost is found,
+ * preferring alternatives and quantifiers as Perl would. That includes ending
+ * a loop at the first iteration that matches nothing, so "(|a)*" matches
+ * nothing at all of "aa". A group in that empty last iteration keeps what it
+ * matched in the iteration before, though, where Perl would have it empty.
+ */
+class Regex {
+public:
+
+	explicit Regex(const std::string&);
+
+	static std::shared_ptr<const Regex> compile(const std::string&);
+
+	bool match(const std::string&) const;
+	bool search(const std::string&, std::size_t,
+		std::vector<std::size_t>&) const;
+	std::string substitute(const std::string&, const std::string&) const;
+
+	std::size_t groups() const { return group_count; }
+
+private:
+
+	enum Operation {
+		BYTE,
+		CLASS,
+		SPLIT,
+		JUMP,
+		SAVE,
+		PROGRESS,
+		BEGIN,
+		END,
+		BOUNDARY,
+		NOT_BOUNDARY,
+		MATCH,
+	};
+
+	struct Instruction {
+		Operation operation;
+		int x;
+		int y;
+	};
+
+	struct Node;
+	class Parser;
+	struct Threads;
+
+	bool run(const std::string&, std::size_t, bool,
+		std::vector<std::size_t>&, Threads&) const;
+	int emit(Operation, int = 0, int = 0);
+	void generate(const Node&);
+
+	std::vector<Instruction> program;
+	std::vector<std::vector<bool>> classes;
+	std::size_t group_count;
+	std::size_t slot_count;
+	int first_byte;
+
+};
+
+
+#endif
@@ -0,0 +1,89 @@
+#include "Scheduler.h"
+#include "Process.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+Scheduler::Scheduler(std::size_t limit) : limit(std::max<std::size_t>(limit,
+	1)) {}
+
+
+Scheduler::~Scheduler() {}
+
+
+Scheduler::Task::Task(const std::vector<std::string>& arguments,
+	const std::string& input, Callback succeeded) : arguments(arguments),
+	input(input), succeeded(succeeded) {}
+
+
+Scheduler::Task::~Task() {}
+
+
+/**
+ * Submit a command, starting it straight away if the limit allows. If the
+ * command exits successfully, the callback, if any, gets its output.
+ */
+Scheduler::Job Scheduler::start(const std::vector<std::string>& arguments,
+	const std::string& input, Callback succeeded) {
+	Job job(new Task(arguments, input, succeeded));
+	queued.push_back(job);
+	launch();
+	return job;
+}
+
+
+/**
+ * Wait for a command to finish and return its output. Until it does, every
+ * running command is serviced, and queued commands are started as running
+ * ones finish, so the command waited for is never starved.
+ */
+const std::string& Scheduler::wait(const Job& job) {
+
+	while (job->error.empty() && !(job->process && job->process->done())) {
+
+		std::vector<Process*> processes;
+		for (auto i = running.begin(); i != running.end(); ++i)
+			processes.push_back((*i)->process.get());
+		Process::pump(processes);
+
+		for (auto i = running.begin(); i != running.end(); ) {
+			const Process& process = *(*i)->process;
+			if (!process.done()) {
+				++i;
+				continue;
+			}
+			if ((*i)->succeeded && process.succeeded())
+				(*i)->succeeded(process.get_output());
+			i = running.erase(i);
+		}
+
+		launch();
+
+	}
+
+	if (!job->error.empty())
+		throw std::runtime_error(job->error);
+
+	return job->process->get_output();
+
+}
+
+
+/**
+ * Start queued commands, in order, until the limit is reached. A command that
+ * can't be started is finished with its error, to be reported to whoever
+ * waits for it.
+ */
+void Scheduler::launch() {
+	while (running.size() < limit && !queued.empty()) {
+		Job job = queued.front();
+		queued.pop_front();
+		try {
+			job->process.reset(new Process(job->arguments, job->input));
+			running.push_back(job);
+		} catch (const std::runtime_error& exception) {
+			job->error = exception.what();
+		}
+		job->input.clear();
+	}
+}
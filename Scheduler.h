@@ -0,0 +1,66 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class Process;
+
+
+/**
+ * Runs external commands concurrently, at most a fixed number at a time.
+ * Commands are started in the order they're submitted, as soon as there's
+ * room; waiting for any one of them keeps all the others moving as well.
+ */
+class Scheduler {
+public:
+
+	struct Task;
+	typedef std::shared_ptr<Task> Job;
+
+	explicit Scheduler(std::size_t);
+	~Scheduler();
+
+	typedef std::function<void(const std::string&)> Callback;
+
+	Job start(const std::vector<std::string>&, const std::string&,
+		Callback = Callback());
+	const std::string& wait(const Job&);
+
+private:
+
+	Scheduler(const Scheduler&) = delete;
+	Scheduler& operator=(const Scheduler&) = delete;
+
+	void launch();
+
+	std::size_t limit;
+	std::deque<Job> queued;
+	std::list<Job> running;
+
+};
+
+
+/**
+ * One command and, eventually, its output or the reason it couldn't run.
+ */
+struct Scheduler::Task {
+
+	Task(const std::vector<std::string>&, const std::string&, Callback);
+	~Task();
+
+	std::vector<std::string> arguments;
+	std::string input;
+	Callback succeeded;
+	std::unique_ptr<Process> process;
+	std::string error;
+
+};
+
+
+#endif
@@ -3,76 +3,64 @@
 #include "Context.h"
 #include "Data.h"
 #include "List.h"
-#include <memory>
 
 #include <iostream>
 
 
-Signature::Signature(const std::string& name) : name(name), canonical(name) {}
+Signature::Signature(Symbol name) : name(name), canonical(name) {}
 
 
 /**
- * Initialize the Signature from another, re-constructing the canonical name.
+ * Initialize the Signature and construct its canonical name, which is interned
+ * so that Signatures can be ordered by a single integer comparison.
  */
-Signature::Signature(const std::string& name, const Signature& signature)
-	: name(name), data(signature.data), content(signature.content) {
+Signature::Signature(Symbol name,
+	const std::vector<std::vector<Symbol>>& data_names,
+	const std::vector<std::vector<Symbol>>& content_names) : name(name) {
 
-	std::ostringstream result;
-	result << name;
+	std::string result = name.string();
 
-	for (auto i = data.begin(); i != data.end(); ++i) {
-		result << '(' << i->first.size();
-		if (i->second) result << '+';
-		result << ')';
+	for (auto i = data_names.begin(); i != data_names.end(); ++i) {
+		const std::string& last = i->back().string();
+		const bool variadic = last.size() > 3 &&
+			last.compare(last.size() - 3, 3, "...") == 0;
+		data.push_back({*i, variadic});
+		result += '(' + std::to_string(i->size()) + (variadic ? "+)" : ")");
 	}
 
-	for (auto i = content.begin(); i != content.end(); ++i) {
-		result << '{' << i->first.size();
-		if (i->second) result << '+';
-		result << '}';
+	for (auto i = content_names.begin(); i != content_names.end(); ++i) {
+		const std::string& last = i->back().string();
+		const bool variadic = last.size() > 3 &&
+			last.compare(last.size() - 3, 3, "...") == 0;
+		content.push_back({*i, variadic});
+		result += '{' + std::to_string(i->size()) + (variadic ? "+}" : "}");
 	}
 
-	canonical = result.str();
+	canonical = result;
 
 }
 
 
 /**
- * Initialize the Signature and construct its canonical name.
+ * Produce the same Signature under a namespace prefix. The canonical name of
+ * the result is just the prefixed canonical name, so both are memoized.
  */
-Signature::Signature(const std::string& name,
-	const std::vector<std::vector<std::string>>& data_names,
-	const std::vector<std::vector<std::string>>& content_names) : name(name) {
-
-	std::ostringstream result;
-	result << name;
-
-	for (auto i = data_names.begin(); i != data_names.end(); ++i) {
-		result << '(' << i->size();
-		if (i->back().size() > 3 &&
-			i->back().substr(i->back().size() - 3, 3) == "...") {
-			data.push_back({*i, true});
-			result << '+';
-		} else {
-			data.push_back({*i, false});
-		}
-		result << ')';
-	}
-
-	for (auto i = content_names.begin(); i != content_names.end(); ++i) {
-		result << '{' << i->size();
-		if (i->back().size() > 3 &&
-			i->back().substr(i->back().size() - 3, 3) == "...") {
-			content.push_back({*i, true});
-			result << '+';
-		} else {
-			content.push_back({*i, false});
-		}
-		result << '}';
-	};
+Signature Signature::qualified(Symbol prefix) const {
+	Signature result(*this);
+	result.name = Symbol::qualify(prefix, name);
+	result.canonical = Symbol::qualify(prefix, canonical);
+	return result;
+}
 
-	canonical = result.str();
 
+/**
+ * Strip any namespace prefix from the Signature.
+ */
+Signature Signature::unqualified() const {
+	Signature result(*this);
+	result.name = Symbol::split(name).second;
+	result.canonical = Symbol::split(canonical).second;
+	return result;
 }
 
 
@@ -92,22 +80,22 @@ void Signature::bind(Context& context,
 		for (element = 0; element < data_section.size() -
 			(data[section].second ? 1 : 0); ++element)
 			context.define(Signature(data_section[element]),
-				std::shared_ptr<const Expression>(new Data
+				Reference<const Expression>(new Data
 				(0, 0, given_data[section][element])));
 
 		if (data[section].second) {
 
-			std::shared_ptr<List> rest(new List(0, 0));
+			Reference<List> rest(new List(0, 0));
 
 			while (element < given_data[section].size()) {
-				rest->add(std::shared_ptr<const Value>(new Data
+				rest->add(Reference<const Value>(new Data
 					(0, 0, given_data[section][element])));
 				++element;
 			}
 
 			context.define(Signature
 				(data_section[data_section.size() - 1]),
-				std::static_pointer_cast<const Expression>(rest));
+				static_reference_cast<const Expression>(rest));
 
 		}
 
@@ -123,22 +111,22 @@ void Signature::bind(Context& context,
 		for (element = 0; element < content_section.size() -
 			(content[section].second ? 1 : 0); ++element)
 			context.define(Signature(content_section[element]),
-				std::shared_ptr<const Expression>(new Content
+				Reference<const Expression>(new Content
 				(0, 0, given_content[section][element])));
 
 		if (content[section].second) {
 
-			std::shared_ptr<List> rest(new List(0, 0));
+			Reference<List> rest(new List(0, 0));
 
 			while (element < given_content[section].size()) {
-				rest->add(std::shared_ptr<const Value>(new Content
+				rest->add(Reference<const Value>(new Content
 					(0, 0, given_content[section][element])));
 				++element;
 			}
 
 			context.define(Signature
 				(content_section[content_section.size() - 1]),
-				std::static_pointer_cast<const Expression>(rest));
+				static_reference_cast<const Expression>(rest));
 
 		}
 
@@ -148,14 +136,13 @@ void Signature::bind(Context& context,
 
 
 /**
- * Test whether a given set of values match a Signature.
+ * Test whether a given set of values match a Signature. Names are matched by
+ * the symbol table, so only the shape of the parameters is checked here.
  */
-bool Signature::matches(const std::string& given_name,
-	const std::vector<std::vector<double>>& given_data,
+bool Signature::matches(const std::vector<std::vector<double>>& given_data,
 	const std::vector<std::vector<std::string>>& given_content) const {
 
-	if (given_name != name ||
-		given_data.size() != data.size() ||
+	if (given_data.size() != data.size() ||
 		given_content.size() != content.size())
 		return false;
 
@@ -177,7 +164,8 @@ bool Signature::matches(const std::string& given_name,
 
 
 /**
- * Compare Signatures for sorting in a map.
+ * Compare Signatures for sorting in a map. This orders by interned ID, not
+ * alphabetically, which is all a map needs.
  */
 bool operator<(const Signature& a, const Signature& b) {
 	return a.canonical < b.canonical;
@@ -1,7 +1,7 @@
 #ifndef SIGNATURE_H
 #define SIGNATURE_H
+#include "Symbol.h"
 #include <algorithm>
-#include <sstream>
 #include <string>
 #include <vector>
 
@@ -18,26 +18,27 @@ class Context;
 class Signature {
 public:
 
-	Signature(const std::string&);
-	Signature(const std::string&, const Signature&);
-	Signature(const std::string&,
-		const std::vector<std::vector<std::string>>&,
-		const std::vector<std::vector<std::string>>&);
+	Signature(Symbol);
+	Signature(Symbol,
+		const std::vector<std::vector<Symbol>>&,
+		const std::vector<std::vector<Symbol>>&);
+
+	Signature qualified(Symbol) const;
+	Signature unqualified() const;
 
 	void bind(Context&,
 		const std::vector<std::vector<double>>&,
 		const std::vector<std::vector<std::string>>&) const;
 
-	bool matches(const std::string&,
-		const std::vector<std::vector<double>>&,
+	bool matches(const std::vector<std::vector<double>>&,
 		const std::vector<std::vector<std::string>>&) const;
 
 	friend bool operator<(const Signature&, const Signature&);
 
-	std::string name;
-	std::vector<std::pair<std::vector<std::string>, bool>> data;
-	std::vector<std::pair<std::vector<std::string>, bool>> content;
-	std::string canonical;
+	Symbol name;
+	std::vector<std::pair<std::vector<Symbol>, bool>> data;
+	std::vector<std::pair<std::vector<Symbol>, bool>> content;
+	Symbol canonical;
 
 };
 
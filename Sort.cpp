@@ -0,0 +1,191 @@
+#include "Sort.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <thread>
+
+
+namespace {
+
+	/**
+	 * Inputs shorter than this are sorted on one thread, since starting more
+	 * would cost more than it saves.
+	 */
+	const std::size_t parallel_threshold = 1 << 17;
+
+	/**
+	 * Inputs shorter than this are sorted by comparison, since a radix sort
+	 * has to make several passes over its buckets whatever the input size.
+	 */
+	const std::size_t radix_threshold = 256;
+
+	struct Datum {
+		uint64_t key;
+		std::size_t index;
+	};
+
+	struct Text {
+		const std::string* key;
+		std::size_t index;
+	};
+
+	bool datum_less(const Datum& a, const Datum& b) {
+		return a.key < b.key;
+	}
+
+	bool text_less(const Text& a, const Text& b) {
+		return *a.key < *b.key;
+	}
+
+	/**
+	 * A double's bits rearranged so that unsigned integer order is numeric
+	 * order: negative numbers have all their bits flipped, and others just
+	 * their sign bit.
+	 */
+	uint64_t radix_key(double value) {
+		if (value == 0) value = 0;
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof bits);
+		return bits & uint64_t(1) << 63 ? ~bits : bits | uint64_t(1) << 63;
+	}
+
+	/**
+	 * An LSD radix sort, one byte at a time, which is stable by nature.
+	 * Passes over bytes that every key has in common are skipped.
+	 */
+	void radix_sort(Datum* begin, Datum* end) {
+
+		const std::size_t size = end - begin;
+		if (size < radix_threshold) {
+			std::stable_sort(begin, end, datum_less);
+			return;
+		}
+
+		std::vector<std::size_t> counts(8 * 256);
+		for (const Datum* i = begin; i != end; ++i)
+			for (int pass = 0; pass < 8; ++pass)
+				++counts[pass * 256 + (i->key >> pass * 8 & 0xff)];
+
+		std::vector<Datum> buffer(size);
+		Datum* from = begin;
+		Datum* to = buffer.data();
+
+		for (int pass = 0; pass < 8; ++pass) {
+			std::size_t* const count = &counts[pass * 256];
+			if (count[from->key >> pass * 8 & 0xff] == size) continue;
+			std::size_t offset = 0;
+			for (int bucket = 0; bucket < 256; ++bucket) {
+				const std::size_t next = offset + count[bucket];
+				count[bucket] = offset;
+				offset = next;
+			}
+			for (std::size_t i = 0; i < size; ++i)
+				to[count[from[i].key >> pass * 8 & 0xff]++] = from[i];
+			std::swap(from, to);
+		}
+
+		if (from != begin)
+			std::copy(from, from + size, begin);
+
+	}
+
+	/**
+	 * Run a task on a new thread, or on this one if there are no more threads
+	 * to be had, as on a host that limits the processes of each user.
+	 */
+	template<class Task>
+	void spawn(std::vector<std::thread>& workers, Task task) {
+		try {
+			workers.emplace_back(task);
+		} catch (const std::system_error&) {
+			task();
+		}
+	}
+
+	/**
+	 * Sort pieces of the input on separate threads, then merge neighbouring
+	 * pieces, also on separate threads, until there's only one. Merging keeps
+	 * the left piece first among equals, so the result is as stable as the
+	 * sort of each piece.
+	 */
+	template<class Item, class Sort, class Less>
+	void parallel_sort(std::vector<Item>& items, Sort sort, Less less) {
+
+		const std::size_t threads = std::max(1u,
+			std::thread::hardware_concurrency());
+		if (items.size() < parallel_threshold || threads == 1) {
+			sort(items.data(), items.data() + items.size());
+			return;
+		}
+
+		std::vector<std::size_t> bounds;
+		for (std::size_t i = 0; i <= threads; ++i)
+			bounds.push_back(items.size() * i / threads);
+
+		std::vector<std::thread> workers;
+		for (std::size_t i = 0; i < threads; ++i) {
+			Item* const first = items.data() + bounds[i];
+			Item* const last = items.data() + bounds[i + 1];
+			spawn(workers, [first, last, sort]() { sort(first, last); });
+		}
+		for (auto i = workers.begin(); i != workers.end(); ++i)
+			i->join();
+
+		while (bounds.size() > 2) {
+			std::vector<std::size_t> merged;
+			workers.clear();
+			for (std::size_t i = 0; i + 2 < bounds.size(); i += 2) {
+				Item* const first = items.data() + bounds[i];
+				Item* const middle = items.data() + bounds[i + 1];
+				Item* const last = items.data() + bounds[i + 2];
+				spawn(workers, [first, middle, last, less]() {
+					std::inplace_merge(first, middle, last, less);
+				});
+				merged.push_back(bounds[i]);
+			}
+			if (bounds.size() % 2 == 0)
+				merged.push_back(bounds[bounds.size() - 2]);
+			merged.push_back(bounds.back());
+			for (auto i = workers.begin(); i != workers.end(); ++i)
+				i->join();
+			bounds.swap(merged);
+		}
+
+	}
+
+}
+
+
+std::vector<std::size_t> sort_content(const std::vector<std::string>& keys) {
+
+	std::vector<Text> items(keys.size());
+	for (std::size_t i = 0; i < keys.size(); ++i)
+		items[i] = Text{&keys[i], i};
+
+	parallel_sort(items, [](Text* begin, Text* end) {
+		std::stable_sort(begin, end, text_less);
+	}, text_less);
+
+	std::vector<std::size_t> result(items.size());
+	for (std::size_t i = 0; i < items.size(); ++i)
+		result[i] = items[i].index;
+	return result;
+
+}
+
+
+std::vector<std::size_t> sort_data(const std::vector<double>& keys) {
+
+	std::vector<Datum> items(keys.size());
+	for (std::size_t i = 0; i < keys.size(); ++i)
+		items[i] = Datum{radix_key(keys[i]), i};
+
+	parallel_sort(items, radix_sort, datum_less);
+
+	std::vector<std::size_t> result(items.size());
+	for (std::size_t i = 0; i < items.size(); ++i)
+		result[i] = items[i].index;
+	return result;
+
+}
@@ -0,0 +1,19 @@
+#ifndef SORT_H
+#define SORT_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/**
+ * Stable sorts, given keys, yielding the order in which to take the elements
+ * the keys belong to. Content keys are compared bytewise; data keys are
+ * sorted by radix, with negative zero equal to zero. Very long inputs are
+ * sorted in pieces on several threads and merged.
+ */
+
+std::vector<std::size_t> sort_content(const std::vector<std::string>&);
+std::vector<std::size_t> sort_data(const std::vector<double>&);
+
+
+#endif
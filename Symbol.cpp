@@ -0,0 +1,122 @@
+#include "Symbol.h"
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+	/**
+	 * The global symbol table. Names are stored as keys of the map, whose
+	 * nodes never move, so the vector can point straight at them.
+	 */
+	struct Table {
+
+		Table() : names{&ids.insert({"", 0}).first->first} {}
+
+		std::unordered_map<std::string, int> ids;
+		std::vector<const std::string*> names;
+		std::unordered_map<uint64_t, int> qualified;
+		std::unordered_map<int, std::pair<int, int>> splits;
+
+	};
+
+	/**
+	 * Constructed on first use, so that static tables of Symbols elsewhere
+	 * don't depend on initialization order.
+	 */
+	Table& table() {
+		static Table instance;
+		return instance;
+	}
+
+	int intern(const std::string& name) {
+		Table& symbols = table();
+		auto position = symbols.ids.find(name);
+		if (position != symbols.ids.end())
+			return position->second;
+		const int id = symbols.names.size();
+		symbols.names.push_back(&symbols.ids.insert({name, id}).first->first);
+		return id;
+	}
+
+}
+
+
+Symbol::Symbol(const std::string& name) : id(intern(name)) {}
+
+
+Symbol::Symbol(const char* name) : id(intern(name)) {}
+
+
+const std::string& Symbol::string() const { return *table().names[id]; }
+
+
+/**
+ * Find the Symbol for a name without interning it, for lookups with names
+ * that come from outside and may never be seen again. A name that was never
+ * interned can't be the name of anything.
+ */
+bool Symbol::find(const std::string& name, Symbol& result) {
+	Table& symbols = table();
+	auto position = symbols.ids.find(name);
+	if (position == symbols.ids.end())
+		return false;
+	result = Symbol(position->second);
+	return true;
+}
+
+
+/**
+ * Produce the Symbol for "prefix::name". Qualified lookups happen for every
+ * template call in every namespace prefix in scope, so the result is memoized
+ * by ID pair, and the string is only ever built once.
+ */
+Symbol Symbol::qualify(Symbol prefix, Symbol name) {
+
+	if (prefix.empty()) return name;
+
+	Table& symbols = table();
+	const uint64_t key =
+		uint64_t(uint32_t(prefix.id)) << 32 | uint32_t(name.id);
+	auto position = symbols.qualified.find(key);
+	if (position != symbols.qualified.end())
+		return Symbol(position->second);
+
+	const int id = intern(prefix.string() + "::" + name.string());
+	symbols.qualified[key] = id;
+	return Symbol(id);
+
+}
+
+
+/**
+ * The inverse of qualify: separate "a::b::name" into "a::b" and "name". An
+ * unqualified name has an empty prefix. Also memoized, since every qualified
+ * lookup walks the namespace tree one prefix at a time.
+ */
+std::pair<Symbol, Symbol> Symbol::split(Symbol symbol) {
+
+	Table& symbols = table();
+	auto position = symbols.splits.find(symbol.id);
+	if (position != symbols.splits.end())
+		return {Symbol(position->second.first),
+			Symbol(position->second.second)};
+
+	const std::string& name = symbol.string();
+	const auto separator = name.rfind("::");
+	const std::pair<Symbol, Symbol> result = separator == std::string::npos ?
+		std::make_pair(Symbol(), symbol) :
+		std::make_pair(Symbol(name.substr(0, separator)),
+			Symbol(name.substr(separator + 2)));
+
+	symbols.splits[symbol.id] = {result.first.id, result.second.id};
+	return result;
+
+}
+
+
+std::ostream& operator<<(std::ostream& stream, Symbol symbol) {
+	return stream << symbol.string();
+}
@@ -0,0 +1,59 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <utility>
+
+
+/**
+ * An interned string. Every distinct name, namespace path, and canonical
+ * Signature is stored exactly once in a global table and identified by a small
+ * integer, so copying, comparing, and ordering Symbols never touches the
+ * characters themselves. The empty string is always Symbol zero.
+ */
+class Symbol {
+public:
+
+	Symbol() : id(0) {}
+	Symbol(const std::string&);
+	Symbol(const char*);
+
+	const std::string& string() const;
+	bool empty() const { return id == 0; }
+	int get_id() const { return id; }
+
+	static bool find(const std::string&, Symbol&);
+	static Symbol qualify(Symbol, Symbol);
+	static std::pair<Symbol, Symbol> split(Symbol);
+
+	friend bool operator==(Symbol a, Symbol b) { return a.id == b.id; }
+	friend bool operator!=(Symbol a, Symbol b) { return a.id != b.id; }
+	friend bool operator<(Symbol a, Symbol b) { return a.id < b.id; }
+
+private:
+
+	explicit Symbol(int id) : id(id) {}
+
+	int id;
+
+};
+
+
+std::ostream& operator<<(std::ostream&, Symbol);
+
+
+namespace std {
+
+	template<>
+	struct hash<Symbol> {
+		std::size_t operator()(Symbol symbol) const {
+			return std::hash<int>()(symbol.get_id());
+		}
+	};
+
+}
+
+
+#endif
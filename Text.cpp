@@ -0,0 +1,381 @@
+#include "Text.h"
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+	/**
+	 * Decode the code point at the start of some text, setting its length in
+	 * bytes. An invalid, overlong, or truncated sequence is one byte long and
+	 * decodes as -1.
+	 */
+	long decode(const unsigned char* data, std::size_t size,
+		std::size_t& length) {
+
+		const unsigned char lead = data[0];
+		length = 1;
+		if (lead < 0x80) return lead;
+
+		std::size_t expected;
+		long result;
+		long minimum;
+		if ((lead & 0xe0) == 0xc0) {
+			expected = 2;
+			result = lead & 0x1f;
+			minimum = 0x80;
+		} else if ((lead & 0xf0) == 0xe0) {
+			expected = 3;
+			result = lead & 0x0f;
+			minimum = 0x800;
+		} else if ((lead & 0xf8) == 0xf0) {
+			expected = 4;
+			result = lead & 0x07;
+			minimum = 0x10000;
+		} else {
+			return -1;
+		}
+
+		if (size < expected) return -1;
+		for (std::size_t i = 1; i < expected; ++i) {
+			if ((data[i] & 0xc0) != 0x80) return -1;
+			result = result << 6 | (data[i] & 0x3f);
+		}
+		if (result < minimum || result > 0x10ffff) return -1;
+
+		length = expected;
+		return result;
+
+	}
+
+	void encode(long point, std::string& result) {
+		if (point < 0x80) {
+			result += char(point);
+		} else if (point < 0x800) {
+			result += char(0xc0 | point >> 6);
+			result += char(0x80 | (point & 0x3f));
+		} else if (point < 0x10000) {
+			result += char(0xe0 | point >> 12);
+			result += char(0x80 | (point >> 6 & 0x3f));
+			result += char(0x80 | (point & 0x3f));
+		} else {
+			result += char(0xf0 | point >> 18);
+			result += char(0x80 | (point >> 12 & 0x3f));
+			result += char(0x80 | (point >> 6 & 0x3f));
+			result += char(0x80 | (point & 0x3f));
+		}
+	}
+
+	/**
+	 * The byte offset of the code point index code points on from the one
+	 * at position, or the size if that's past the end.
+	 */
+	std::size_t offset(const std::string& text, std::size_t position,
+		std::size_t index) {
+		const unsigned char* data =
+			reinterpret_cast<const unsigned char*>(text.data());
+		while (index && position < text.size()) {
+			std::size_t length;
+			decode(data + position, text.size() - position, length);
+			position += length;
+			--index;
+		}
+		return position;
+	}
+
+	bool latin_pair_upper_even(long point) {
+		return (point >= 0x100 && point <= 0x137)
+			|| (point >= 0x14a && point <= 0x177);
+	}
+
+	bool latin_pair_upper_odd(long point) {
+		return (point >= 0x139 && point <= 0x148)
+			|| (point >= 0x179 && point <= 0x17e);
+	}
+
+	long upper_point(long point) {
+		if (point >= 'a' && point <= 'z') return point - 0x20;
+		if (point >= 0xe0 && point <= 0xfe && point != 0xf7)
+			return point - 0x20;
+		if (point == 0xff) return 0x178;
+		if (latin_pair_upper_even(point) && point % 2 == 1) return point - 1;
+		if (latin_pair_upper_odd(point) && point % 2 == 0) return point - 1;
+		if (point == 0x3c2) return 0x3a3;
+		if (point >= 0x3b1 && point <= 0x3c9) return point - 0x20;
+		if (point == 0x3ac) return 0x386;
+		if (point >= 0x3ad && point <= 0x3af) return point - 0x25;
+		if (point == 0x3cc) return 0x38c;
+		if (point >= 0x3cd && point <= 0x3ce) return point - 0x3f;
+		if (point >= 0x430 && point <= 0x44f) return point - 0x20;
+		if (point >= 0x450 && point <= 0x45f) return point - 0x50;
+		return point;
+	}
+
+	long lower_point(long point) {
+		if (point >= 'A' && point <= 'Z') return point + 0x20;
+		if (point >= 0xc0 && point <= 0xde && point != 0xd7)
+			return point + 0x20;
+		if (point == 0x178) return 0xff;
+		if (latin_pair_upper_even(point) && point % 2 == 0) return point + 1;
+		if (latin_pair_upper_odd(point) && point % 2 == 1) return point + 1;
+		if (point >= 0x391 && point <= 0x3a9 && point != 0x3a2)
+			return point + 0x20;
+		if (point == 0x386) return 0x3ac;
+		if (point >= 0x388 && point <= 0x38a) return point + 0x25;
+		if (point == 0x38c) return 0x3cc;
+		if (point >= 0x38e && point <= 0x38f) return point + 0x3f;
+		if (point >= 0x410 && point <= 0x42f) return point + 0x20;
+		if (point >= 0x400 && point <= 0x40f) return point + 0x50;
+		return point;
+	}
+
+	/**
+	 * Map the case of some text. Runs of ASCII are done sixteen bytes at a
+	 * time where the hardware allows, by flipping the case bit of every byte
+	 * between first and last; anything else goes a code point at a time.
+	 */
+	std::string map_case(const std::string& text, char first, char last,
+		long (*map)(long)) {
+
+		std::string result;
+		result.reserve(text.size());
+		const unsigned char* data =
+			reinterpret_cast<const unsigned char*>(text.data());
+		const std::size_t size = text.size();
+		std::size_t i = 0;
+
+		while (i < size) {
+
+#ifdef __SSE2__
+			const __m128i below = _mm_set1_epi8(first - 1);
+			const __m128i above = _mm_set1_epi8(last + 1);
+			const __m128i flip = _mm_set1_epi8(0x20);
+			while (i + 16 <= size) {
+				const __m128i chunk = _mm_loadu_si128
+					(reinterpret_cast<const __m128i*>(data + i));
+				if (_mm_movemask_epi8(chunk)) break;
+				const __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8
+					(chunk, below), _mm_cmplt_epi8(chunk, above));
+				char mapped[16];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(mapped),
+					_mm_xor_si128(chunk, _mm_and_si128(in_range, flip)));
+				result.append(mapped, 16);
+				i += 16;
+			}
+			if (i == size) break;
+#endif
+
+			std::size_t length;
+			const long point = decode(data + i, size - i, length);
+			if (point == -1)
+				result += char(data[i]);
+			else if (point < 0x80)
+				result += char(point >= first && point <= last ?
+					point ^ 0x20 : point);
+			else
+				encode(map(point), result);
+			i += length;
+
+		}
+
+		return result;
+
+	}
+
+	bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'
+			|| c == '\v';
+	}
+
+}
+
+
+/**
+ * Count code points by counting the bytes that aren't continuation bytes,
+ * which are the ones from 0x80 to 0xBF, or -128 to -65 as signed bytes.
+ */
+std::size_t text_length(const std::string& text) {
+
+	const char* data = text.data();
+	const std::size_t size = text.size();
+	std::size_t result = 0;
+	std::size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i continuation = _mm_set1_epi8(-65);
+	for (; i + 16 <= size; i += 16) {
+		const __m128i chunk = _mm_loadu_si128
+			(reinterpret_cast<const __m128i*>(data + i));
+		result += __builtin_popcount(_mm_movemask_epi8
+			(_mm_cmpgt_epi8(chunk, continuation)));
+	}
+#endif
+
+	for (; i < size; ++i)
+		if (int8_t(data[i]) > -65)
+			++result;
+
+	return result;
+
+}
+
+
+/**
+ * Take up to count code points from start. A negative start counts from the
+ * end; a negative count means the rest of the text.
+ */
+std::string text_substring(const std::string& text, long start,
+	long count) {
+
+	if (start < 0) {
+		start += text_length(text);
+		if (start < 0) start = 0;
+	}
+
+	const std::size_t begin = offset(text, 0, start);
+	if (count < 0)
+		return text.substr(begin);
+
+	const std::size_t end = offset(text, begin, count);
+	return text.substr(begin, end - begin);
+
+}
+
+
+/**
+ * Find a byte sequence. Candidate positions are those where both the first
+ * and the last byte of the needle match, which are found sixteen at a time
+ * where the hardware allows, and only those are compared in full.
+ */
+std::size_t text_find(const std::string& haystack, const std::string& needle,
+	std::size_t from) {
+
+	const std::size_t size = needle.size();
+	if (size == 0) return from <= haystack.size() ? from : std::string::npos;
+	if (from > haystack.size() || haystack.size() - from < size)
+		return std::string::npos;
+
+	const char* data = haystack.data();
+	const std::size_t last = haystack.size() - size;
+	std::size_t i = from;
+
+#ifdef __SSE2__
+	if (size > 1) {
+		const __m128i head = _mm_set1_epi8(needle[0]);
+		const __m128i tail = _mm_set1_epi8(needle[size - 1]);
+		for (; i + 16 <= last + 1; i += 16) {
+			const __m128i first = _mm_loadu_si128
+				(reinterpret_cast<const __m128i*>(data + i));
+			const __m128i final = _mm_loadu_si128
+				(reinterpret_cast<const __m128i*>(data + i + size - 1));
+			int mask = _mm_movemask_epi8(_mm_and_si128
+				(_mm_cmpeq_epi8(first, head), _mm_cmpeq_epi8(final, tail)));
+			while (mask) {
+				const int bit = __builtin_ctz(mask);
+				if (std::memcmp(data + i + bit + 1, needle.data() + 1,
+					size - 2) == 0)
+					return i + bit;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+
+	while (i <= last) {
+		const void* position = std::memchr(data + i, needle[0], last - i + 1);
+		if (!position) break;
+		i = static_cast<const char*>(position) - data;
+		if (std::memcmp(data + i, needle.data(), size) == 0)
+			return i;
+		++i;
+	}
+
+	return std::string::npos;
+
+}
+
+
+/**
+ * Replace every occurrence of one string with another, left to right.
+ */
+std::string text_replace(const std::string& text, const std::string& from,
+	const std::string& to) {
+
+	if (from.empty()) return text;
+
+	std::string result;
+	std::size_t begin = 0;
+	std::size_t position;
+
+	while ((position = text_find(text, from, begin)) != std::string::npos) {
+		if (result.empty()) result.reserve(text.size());
+		result.append(text, begin, position - begin);
+		result += to;
+		begin = position + from.size();
+	}
+
+	if (begin == 0) return text;
+	result.append(text, begin, std::string::npos);
+	return result;
+
+}
+
+
+/**
+ * Split text at every occurrence of a separator, or into code points if the
+ * separator is empty. The empty string has no parts.
+ */
+std::vector<std::string> text_split(const std::string& text,
+	const std::string& separator) {
+
+	std::vector<std::string> result;
+	if (text.empty()) return result;
+
+	if (separator.empty()) {
+		const unsigned char* data =
+			reinterpret_cast<const unsigned char*>(text.data());
+		for (std::size_t i = 0; i < text.size(); ) {
+			std::size_t length;
+			decode(data + i, text.size() - i, length);
+			result.push_back(text.substr(i, length));
+			i += length;
+		}
+		return result;
+	}
+
+	std::size_t begin = 0;
+	std::size_t position;
+	while ((position = text_find(text, separator, begin))
+		!= std::string::npos) {
+		result.push_back(text.substr(begin, position - begin));
+		begin = position + separator.size();
+	}
+	result.push_back(text.substr(begin));
+	return result;
+
+}
+
+
+std::string text_lower(const std::string& text) {
+	return map_case(text, 'A', 'Z', lower_point);
+}
+
+
+std::string text_upper(const std::string& text) {
+	return map_case(text, 'a', 'z', upper_point);
+}
+
+
+/**
+ * Remove ASCII whitespace from both ends.
+ */
+std::string text_trim(const std::string& text) {
+	std::size_t begin = 0;
+	std::size_t end = text.size();
+	while (begin < end && is_space(text[begin])) ++begin;
+	while (end > begin && is_space(text[end - 1])) --end;
+	return text.substr(begin, end - begin);
+}
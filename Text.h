@@ -0,0 +1,27 @@
+#ifndef TEXT_H
+#define TEXT_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/**
+ * String operations on UTF-8 text. Lengths and positions count code points,
+ * not bytes; searching works on bytes, which is safe because no UTF-8 code
+ * point is ever part of another. Case mapping covers ASCII, Latin-1, Latin
+ * Extended-A, Greek, and Cyrillic. Invalid sequences are passed through as
+ * single bytes, each counting as one code point.
+ */
+
+std::size_t text_length(const std::string&);
+std::string text_substring(const std::string&, long, long);
+std::size_t text_find(const std::string&, const std::string&, std::size_t);
+std::string text_replace(const std::string&, const std::string&,
+	const std::string&);
+std::vector<std::string> text_split(const std::string&, const std::string&);
+std::string text_lower(const std::string&);
+std::string text_upper(const std::string&);
+std::string text_trim(const std::string&);
+
+
+#endif
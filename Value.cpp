@@ -1,4 +1,5 @@
 #include "Value.h"
+#include <ostream>
 
 
 Value::Value(int line, int column) : Expression(line, column) {}
@@ -8,14 +9,18 @@ Value::~Value() {}
 
 
 /**
- * Return a reference to this Value, or else a reference to a copy of it.
+ * Return a reference to this Value, or else, if nothing refers to it (as with
+ * temporaries), a reference to a copy of it.
  */
-std::shared_ptr<const Value> Value::self_reference() const try {
-
-	return shared_from_this();
-
-} catch (const std::bad_weak_ptr&) {
+Reference<const Value> Value::self_reference() const {
+	return Reference<const Value>(referenced() ? this : clone());
+}
 
-	return std::shared_ptr<const Value>(clone());
 
+/**
+ * Send the content of this Value to a stream, without necessarily building it
+ * as a string first.
+ */
+void Value::write_content(std::ostream& stream) const {
+	stream << get_content();
 }
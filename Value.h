@@ -1,20 +1,23 @@
 #ifndef VALUE_H
 #define VALUE_H
 #include "Expression.h"
+#include <iosfwd>
 
 
 /**
  * A literal expression that requires no computation.
  */
-class Value : public Expression, public std::enable_shared_from_this<Value> {
+class Value : public Expression {
 public:
 
 	Value(int, int);
 	virtual ~Value();
 
+	virtual void write_content(std::ostream&) const;
+
 protected:
 
-	std::shared_ptr<const Value> self_reference() const;
+	Reference<const Value> self_reference() const;
 	virtual Value* clone() const = 0;
 
 };
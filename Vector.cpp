@@ -0,0 +1,298 @@
+#include "Vector.h"
+#include <algorithm>
+#include <stdexcept>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_AVX2
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+	/**
+	 * Every operation has a scalar form, and with AVX2, a vector form that
+	 * does four elements at once.
+	 */
+
+	struct Add {
+		static double scalar(double a, double b) { return a + b; }
+	};
+
+	struct Subtract {
+		static double scalar(double a, double b) { return a - b; }
+	};
+
+	struct Multiply {
+		static double scalar(double a, double b) { return a * b; }
+	};
+
+	struct Divide {
+		static double scalar(double a, double b) { return a / b; }
+	};
+
+	struct Less {
+		static double scalar(double a, double b) { return a < b; }
+	};
+
+	struct NotLess {
+		static double scalar(double a, double b) { return a >= b; }
+	};
+
+	struct Equal {
+		static double scalar(double a, double b) { return a == b; }
+	};
+
+	struct NotEqual {
+		static double scalar(double a, double b) { return a != b; }
+	};
+
+	struct Greater {
+		static double scalar(double a, double b) { return a > b; }
+	};
+
+	struct NotGreater {
+		static double scalar(double a, double b) { return a <= b; }
+	};
+
+	template<class Operation>
+	void scalar_apply(const double* a, const double* b, double* result,
+		std::size_t size) {
+		for (std::size_t i = 0; i < size; ++i)
+			result[i] = Operation::scalar(a[i], b[i]);
+	}
+
+#ifdef VECTOR_AVX2
+
+	bool has_avx2() {
+		static const bool result = __builtin_cpu_supports("avx2");
+		return result;
+	}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+	__m256d vector(Add, __m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+
+	__m256d vector(Subtract, __m256d a, __m256d b) {
+		return _mm256_sub_pd(a, b);
+	}
+
+	__m256d vector(Multiply, __m256d a, __m256d b) {
+		return _mm256_mul_pd(a, b);
+	}
+
+	__m256d vector(Divide, __m256d a, __m256d b) {
+		return _mm256_div_pd(a, b);
+	}
+
+	/**
+	 * Comparisons give all-ones masks, which are turned into 1.0 or 0.0.
+	 */
+	template<int predicate>
+	__m256d compare(__m256d a, __m256d b) {
+		return _mm256_and_pd(_mm256_cmp_pd(a, b, predicate),
+			_mm256_set1_pd(1.0));
+	}
+
+	__m256d vector(Less, __m256d a, __m256d b) {
+		return compare<_CMP_LT_OQ>(a, b);
+	}
+
+	__m256d vector(NotLess, __m256d a, __m256d b) {
+		return compare<_CMP_GE_OQ>(a, b);
+	}
+
+	__m256d vector(Equal, __m256d a, __m256d b) {
+		return compare<_CMP_EQ_OQ>(a, b);
+	}
+
+	__m256d vector(NotEqual, __m256d a, __m256d b) {
+		return compare<_CMP_NEQ_UQ>(a, b);
+	}
+
+	__m256d vector(Greater, __m256d a, __m256d b) {
+		return compare<_CMP_GT_OQ>(a, b);
+	}
+
+	__m256d vector(NotGreater, __m256d a, __m256d b) {
+		return compare<_CMP_LE_OQ>(a, b);
+	}
+
+	template<class Operation>
+	void vector_apply(const double* a, const double* b, double* result,
+		std::size_t size) {
+		std::size_t i = 0;
+		for (; i + 4 <= size; i += 4)
+			_mm256_storeu_pd(result + i, vector(Operation(),
+				_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		for (; i < size; ++i)
+			result[i] = Operation::scalar(a[i], b[i]);
+	}
+
+	/**
+	 * Sums are kept in four lanes, four vectors at a time, so that the adds
+	 * don't all wait on one another.
+	 */
+	double vector_sum_avx2(const double* values, std::size_t size) {
+		__m256d sums[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(),
+			_mm256_setzero_pd(), _mm256_setzero_pd()};
+		std::size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+			for (int j = 0; j < 4; ++j)
+				sums[j] = _mm256_add_pd(sums[j],
+					_mm256_loadu_pd(values + i + j * 4));
+		for (; i + 4 <= size; i += 4)
+			sums[0] = _mm256_add_pd(sums[0], _mm256_loadu_pd(values + i));
+		const __m256d total = _mm256_add_pd(_mm256_add_pd(sums[0], sums[1]),
+			_mm256_add_pd(sums[2], sums[3]));
+		double lanes[4];
+		_mm256_storeu_pd(lanes, total);
+		double result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+		for (; i < size; ++i)
+			result += values[i];
+		return result;
+	}
+
+	template<bool maximum>
+	double vector_extreme_avx2(const double* values, std::size_t size) {
+		std::size_t i = 0;
+		double result = values[0];
+		if (size >= 4) {
+			__m256d extreme = _mm256_loadu_pd(values);
+			for (i = 4; i + 4 <= size; i += 4) {
+				const __m256d next = _mm256_loadu_pd(values + i);
+				extreme = maximum ? _mm256_max_pd(extreme, next)
+					: _mm256_min_pd(extreme, next);
+			}
+			double lanes[4];
+			_mm256_storeu_pd(lanes, extreme);
+			result = lanes[0];
+			for (int j = 1; j < 4; ++j)
+				result = maximum ? std::max(result, lanes[j])
+					: std::min(result, lanes[j]);
+		}
+		for (; i < size; ++i)
+			result = maximum ? std::max(result, values[i])
+				: std::min(result, values[i]);
+		return result;
+	}
+
+#pragma GCC pop_options
+
+#endif
+
+	template<class Operation>
+	void apply(const double* a, const double* b, double* result,
+		std::size_t size) {
+#ifdef VECTOR_AVX2
+		if (has_avx2()) {
+			vector_apply<Operation>(a, b, result, size);
+			return;
+		}
+#endif
+		scalar_apply<Operation>(a, b, result, size);
+	}
+
+}
+
+
+void vector_add(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<Add>(a, b, result, size);
+}
+
+
+void vector_subtract(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<Subtract>(a, b, result, size);
+}
+
+
+void vector_multiply(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<Multiply>(a, b, result, size);
+}
+
+
+/**
+ * As with the scalar builtin, dividing by zero is an error, checked before
+ * anything is divided.
+ */
+void vector_divide(const double* a, const double* b, double* result,
+	std::size_t size) {
+	if (std::find(b, b + size, 0.0) != b + size)
+		throw std::runtime_error("Division by zero.");
+	apply<Divide>(a, b, result, size);
+}
+
+
+void vector_less(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<Less>(a, b, result, size);
+}
+
+
+void vector_not_less(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<NotLess>(a, b, result, size);
+}
+
+
+void vector_equal(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<Equal>(a, b, result, size);
+}
+
+
+void vector_not_equal(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<NotEqual>(a, b, result, size);
+}
+
+
+void vector_greater(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<Greater>(a, b, result, size);
+}
+
+
+void vector_not_greater(const double* a, const double* b, double* result,
+	std::size_t size) {
+	apply<NotGreater>(a, b, result, size);
+}
+
+
+double vector_sum(const double* values, std::size_t size) {
+#ifdef VECTOR_AVX2
+	if (has_avx2())
+		return vector_sum_avx2(values, size);
+#endif
+	double result = 0;
+	for (std::size_t i = 0; i < size; ++i)
+		result += values[i];
+	return result;
+}
+
+
+/**
+ * The least of some values, of which there must be at least one.
+ */
+double vector_min(const double* values, std::size_t size) {
+#ifdef VECTOR_AVX2
+	if (has_avx2())
+		return vector_extreme_avx2<false>(values, size);
+#endif
+	return *std::min_element(values, values + size);
+}
+
+
+/**
+ * The greatest of some values, of which there must be at least one.
+ */
+double vector_max(const double* values, std::size_t size) {
+#ifdef VECTOR_AVX2
+	if (has_avx2())
+		return vector_extreme_avx2<true>(values, size);
+#endif
+	return *std::max_element(values, values + size);
+}
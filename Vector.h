@@ -0,0 +1,34 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+#include <cstddef>
+
+
+/**
+ * Arithmetic over arrays of doubles, for math on whole Lists. Each binary
+ * kernel combines two arrays of the same size element by element; the
+ * comparisons give 1 or 0, as the math builtins do. Where the processor has
+ * AVX2, four elements are done at a time, and the order in which a sum is
+ * added up differs accordingly.
+ */
+
+typedef void(VectorFunction)(const double*, const double*, double*,
+	std::size_t);
+
+VectorFunction
+	vector_add,
+	vector_subtract,
+	vector_multiply,
+	vector_divide,
+	vector_less,
+	vector_not_less,
+	vector_equal,
+	vector_not_equal,
+	vector_greater,
+	vector_not_greater;
+
+double vector_sum(const double*, std::size_t);
+double vector_min(const double*, std::size_t);
+double vector_max(const double*, std::size_t);
+
+
+#endif
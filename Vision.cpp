@@ -1,16 +1,42 @@
 #include "Vision.h"
+#include "Batch.h"
+#include "Cache.h"
 #include "Content.h"
 #include "Context.h"
 #include "Data.h"
+#include "Escape.h"
+#include "Expression.h"
+#include "Image.h"
 #include "Interpreter.h"
+#include "Json.h"
+#include "List.h"
+#include "Mapping.h"
+#include "Multipart.h"
+#include "Output.h"
 #include "Parser.h"
+#include "Query.h"
 #include "Scanner.h"
+#include "Scheduler.h"
 #include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace {
+
+	/**
+	 * The most of a request body that's held in memory. For multipart
+	 * bodies, which send files to disk as they arrive, that's the fields.
+	 */
+	const long body_limit = 64L << 20;
+
+}
 
 
 /**
@@ -25,9 +51,9 @@ std::string environment_string(const char* name) {
 /**
  * Return the numeric value of an environment variable.
  */
-int environment_number(const char* name) {
+long environment_number(const char* name) {
 	std::istringstream stream(environment_string(name));
-	int result;
+	long result;
 	if (!(stream >> result)) return 0;
 	return result;
 }
@@ -35,24 +61,41 @@ int environment_number(const char* name) {
 
 /**
  * Initialise the runtime, setting default options, and producing a sane help
- * message if parsing the command line or CGI environment fails.
+ * message if parsing the command line fails. A bad request is the client's
+ * fault, not the command line's, so it gets no help message.
  */
-Vision::Vision(int argc, char** argv) try : output_format(TEXT),
-	indent_mode(false), pedantic_mode(false), silent_mode(false),
-	head_mode(false), tab_size(4) {
+Vision::Vision(int argc, char** argv) : output_format(TEXT),
+	direct_mode(false), indent_mode(false), pedantic_mode(false),
+	silent_mode(false), head_mode(false), tab_size(4), concurrency(0),
+	input_escape(nullptr), jobs(0), cache_lifetime(0), cache_size(0) {
+
+	try {
+		parse_options(argc, argv);
+	} catch (const std::runtime_error& exception) {
+		std::ostringstream message;
+		message << "Invalid command line:\n" << exception.what()
+			<< "\nUsage: vision [-a COUNT] [-b RECORDS [-d DIRECTORY] "
+			"[-j COUNT]] [-c DIRECTORY [-e SECONDS] [-k VERSION] "
+			"[-m MEGABYTES]] [-h] [-i] [-l PRELUDE] [-o FORMAT] [-p] "
+			"[-r ESCAPE] [-s] [-t SIZE] [-x] (FILENAME | -)";
+		throw std::runtime_error(message.str());
+	}
 
-	parse_options(argc, argv);
-	parse_environment();
+	try {
+		parse_environment();
+	} catch (const std::runtime_error& exception) {
+		std::ostringstream message;
+		message << "Invalid request:\n" << exception.what();
+		throw std::runtime_error(message.str());
+	}
 
-} catch (const std::runtime_error& exception) {
+}
 
-	std::ostringstream message;
-	message << "Invalid command line:\n" << exception.what()
-		<< "\nUsage: vision [-h] [-i] [-o FORMAT] [-p] [-s] [-t SIZE] "
-		"(FILENAME | -)";
-	throw std::runtime_error(message.str());
 
-}
+/**
+ * Uploaded files are deleted on the way out.
+ */
+Vision::~Vision() {}
 
 
 /**
@@ -66,6 +109,71 @@ void Vision::parse_options(int argc, char** argv) {
 
 	std::list<std::string>::iterator option;
 
+	// -a COUNT
+	if ((option = std::find(args.begin(), args.end(), "-a")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected count after -a option.");
+		std::istringstream stream(*value);
+		if (!(stream >> concurrency) || concurrency < 1) {
+			std::ostringstream message;
+			message << "Invalid concurrency \"" << *value << "\".";
+			throw std::runtime_error(message.str());
+		}
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -b RECORDS
+	if ((option = std::find(args.begin(), args.end(), "-b")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected records filename after -b.");
+		records = *value;
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -c DIRECTORY
+	if ((option = std::find(args.begin(), args.end(), "-c")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected cache directory after -c.");
+		cache_directory = *value;
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -d DIRECTORY
+	if ((option = std::find(args.begin(), args.end(), "-d")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected output directory after -d.");
+		output_directory = *value;
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -e SECONDS
+	if ((option = std::find(args.begin(), args.end(), "-e")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected seconds after -e option.");
+		std::istringstream stream(*value);
+		if (!(stream >> cache_lifetime) || cache_lifetime < 0) {
+			std::ostringstream message;
+			message << "Invalid cache lifetime \"" << *value << "\".";
+			throw std::runtime_error(message.str());
+		}
+		args.erase(option);
+		args.erase(value);
+	}
+
 	// -h
 	if ((option = std::find(args.begin(), args.end(), "-h")) != args.end()) {
 		head_mode = true;
@@ -78,6 +186,60 @@ void Vision::parse_options(int argc, char** argv) {
 		args.erase(option);
 	}
 
+	// -j COUNT
+	if ((option = std::find(args.begin(), args.end(), "-j")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected count after -j option.");
+		std::istringstream stream(*value);
+		if (!(stream >> jobs) || jobs < 1) {
+			std::ostringstream message;
+			message << "Invalid job count \"" << *value << "\".";
+			throw std::runtime_error(message.str());
+		}
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -k VERSION
+	if ((option = std::find(args.begin(), args.end(), "-k")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected version key after -k.");
+		cache_version = *value;
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -l PRELUDE
+	if ((option = std::find(args.begin(), args.end(), "-l")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected prelude filename after -l.");
+		prelude = *value;
+		args.erase(option);
+		args.erase(value);
+	}
+
+	// -m MEGABYTES
+	if ((option = std::find(args.begin(), args.end(), "-m")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected size after -m option.");
+		std::istringstream stream(*value);
+		if (!(stream >> cache_size) || cache_size < 0) {
+			std::ostringstream message;
+			message << "Invalid cache size \"" << *value << "\".";
+			throw std::runtime_error(message.str());
+		}
+		args.erase(option);
+		args.erase(value);
+	}
+
 	// -o FORMAT
 	if ((option = std::find(args.begin(), args.end(), "-o")) != args.end()) {
 		auto value = option;
@@ -105,6 +267,29 @@ void Vision::parse_options(int argc, char** argv) {
 		args.erase(option);
 	}
 
+	// -r ESCAPE
+	if ((option = std::find(args.begin(), args.end(), "-r")) != args.end()) {
+		auto value = option;
+		++value;
+		if (value == args.end())
+			throw std::runtime_error("Expected escape after -r option.");
+		if (*value == "html") {
+			input_escape = escape_html;
+		} else if (*value == "json") {
+			input_escape = escape_json;
+		} else if (*value == "shell") {
+			input_escape = escape_shell;
+		} else if (*value == "url") {
+			input_escape = escape_url;
+		} else {
+			std::ostringstream message;
+			message << "Invalid escape \"" << *value << "\".";
+			throw std::runtime_error(message.str());
+		}
+		args.erase(option);
+		args.erase(value);
+	}
+
 	// -s
 	if ((option = std::find(args.begin(), args.end(), "-s")) != args.end()) {
 		silent_mode = true;
@@ -128,6 +313,19 @@ void Vision::parse_options(int argc, char** argv) {
 		args.erase(value);
 	}
 
+	// -x
+	if ((option = std::find(args.begin(), args.end(), "-x")) != args.end()) {
+		direct_mode = true;
+		args.erase(option);
+	}
+
+	if (cache_directory.empty() && (cache_lifetime || cache_size ||
+		!cache_version.empty()))
+		throw std::runtime_error("Expected -c with cache options.");
+
+	if (records.empty() && (jobs || !output_directory.empty()))
+		throw std::runtime_error("Expected -b with batch options.");
+
 	if (args.size() != 1)
 		throw std::runtime_error("Expected filename or \"-\".");
 
@@ -138,9 +336,7 @@ void Vision::parse_options(int argc, char** argv) {
 
 
 /**
- * Parse CGI environment variables and CGI input over GET and POST. Handles
- * requests only in the usual application/x-www-form-urlencoded format, and
- * should probably handle multipart/form-data in the future.
+ * Parse CGI environment variables and CGI input over GET and POST.
  */
 void Vision::parse_environment() {
 
@@ -171,19 +367,17 @@ void Vision::parse_environment() {
 	for (auto i = variables; *i; ++i)
 		cgi[*i] = environment_string(*i);
 
+	content_length = std::max(environment_number("CONTENT_LENGTH"), 0L);
+
 	const auto& request_method = cgi["REQUEST_METHOD"];
 
 	if (request_method == "GET") {
 
-		decode_variables(cgi["QUERY_STRING"]);
+		query.reset(new Query(cgi["QUERY_STRING"], input_escape));
 
 	} else if (request_method == "POST") {
 
-		std::string content;
-		content.resize(content_length);
-		std::cin.read(&content[0], content_length);
-		// TODO: magic for multipart/form-data?
-		decode_variables(content);
+		read_body();
 
 	} else if (request_method == "HEAD") {
 
@@ -195,95 +389,170 @@ void Vision::parse_environment() {
 
 
 /**
- * Get the hexadecimal value of a character.
- */
-uint8_t hex_value(char c) {
-	if (c >= '0' && c <= '9') return c - '0';
-	if (c >= 'a' && c <= 'f') return c - 'a' + 0xa;
-	if (c >= 'A' && c <= 'F') return c - 'A' + 0xa;
-	return 0;
-}
-
-
-/**
- * Decode a URL-encoded string.
+ * Read a POST body of CONTENT_LENGTH bytes from standard input, a chunk at a
+ * time. A multipart/form-data body is parsed as it arrives, with uploaded
+ * files going straight to disk; a JSON body is checked once it's all there;
+ * anything else is taken to be URL-encoded. Those last two are held in memory,
+ * so they're refused if CONTENT_LENGTH is over the limit, before anything is
+ * allocated for them.
  */
-std::string url_decode(const std::string& encoded) {
-
-	std::ostringstream result;
-
-	for (std::string::size_type i = 0; i < encoded.size(); ++i) {
-
-		if (encoded[i] == '%') {
-
-			const uint8_t upper(hex_value(encoded[i + 1]));
-			const uint8_t lower(hex_value(encoded[i + 2]));
-			result << char(((upper << 4) | lower) & 0xff);
-			i += 2;
-
-		} else if (encoded[i] == '+') {
-
-			result << ' ';
-
-		} else {
-
-			result << encoded[i];
+void Vision::read_body() {
+
+	const std::string boundary = Multipart::boundary(cgi["CONTENT_TYPE"]);
+	std::string content;
+	if (!boundary.empty())
+		form.reset(new Multipart(boundary, body_limit));
+	else if (content_length > body_limit)
+		throw std::runtime_error("Request body is too large.");
+
+	std::vector<char> buffer(1 << 16);
+	long remaining = content_length;
+
+	while (remaining > 0 && std::cin) {
+		std::cin.read(&buffer[0], std::min<long>(remaining, buffer.size()));
+		const std::streamsize size = std::cin.gcount();
+		if (size <= 0) break;
+		remaining -= size;
+		if (form)
+			form->feed(&buffer[0], size);
+		else
+			content.append(&buffer[0], size);
+	}
 
-		}
+	if (remaining > 0)
+		throw std::runtime_error
+			("Request body is shorter than CONTENT_LENGTH.");
 
+	if (form) {
+		form->finish();
+		input.insert(form->get_fields().begin(), form->get_fields().end());
+	} else if (Json::describes(cgi["CONTENT_TYPE"])) {
+		json.reset(new Json(content));
+	} else {
+		query.reset(new Query(content, input_escape));
 	}
 
-	return result.str();
+}
+
 
+/**
+ * Pass runtime options on to the Context of an Interpreter.
+ */
+void Vision::configure(Context& context) const {
+	context.direct_mode = direct_mode;
+	context.head_mode = head_mode;
+	context.indent_mode = indent_mode;
+	context.pedantic_mode = pedantic_mode;
+	context.silent_mode = silent_mode;
+	context.tab_size = tab_size;
+	if (concurrency)
+		context.scheduler.reset(new Scheduler(concurrency));
+	if (!cache_directory.empty())
+		context.cache.reset(new Cache(cache_directory, cache_version,
+			cache_lifetime, uint64_t(cache_size) << 20));
 }
 
 
 /**
- * Parse an application/x-www-form-urlencoded string into a map.
+ * Define everything from the prelude in the Context of an Interpreter. The
+ * prelude is run only if its image (the prelude filename plus ".image") is
+ * missing or stale, in which case the image is rebuilt for the next run. The
+ * image is only a cache, so failing to write it, say to a read-only directory,
+ * just means the prelude is run again next time. The output of the prelude is
+ * discarded; only its definitions and headers count.
  */
-void Vision::decode_variables(const std::string& raw) {
+void Vision::define_prelude(Context& context) const try {
 
-	std::istringstream query(raw);
-	std::string name;
-	std::string value;
+	if (prelude.empty()) return;
 
-	while (true) {
+	const std::string image = prelude + ".image";
+	if (Image::load(image, context)) return;
 
-		if (!std::getline(query, name, '=')) break;
-		input[url_decode(name)] = std::getline(query, value, '&') ?
-			url_decode(value) : "";
+	std::ifstream file(prelude.c_str(), std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Unable to open prelude.");
 
-	}
+	const Scanner scanner(file);
+	const Parser parser(scanner);
+	parser.run(context)->evaluate(context);
+	context.sources.insert(prelude);
+	try {
+		Image::save(image, context);
+	} catch (const std::runtime_error&) {}
+
+} catch (const std::runtime_error& exception) {
+
+	std::ostringstream message;
+	message << "In prelude " << prelude << ":\n" << exception.what();
+	throw std::runtime_error(message.str());
 
 }
 
 
 /**
- * Inject CGI and request variables into the Context of an Interpreter.
+ * Inject CGI and request variables into the Context of an Interpreter. URL-
+ * encoded variables and the members of a JSON body are only decoded if the
+ * template asks for them.
+ *
+ * With -r, what the client sent is escaped on the way in, so that the template
+ * can't forget to: GET and POST fields, including the members of a JSON body,
+ * the CGI variables taken straight from the request (CONTENT_TYPE, PATH_INFO,
+ * QUERY_STRING, and the HTTP_ headers), and the name and type of each upload.
+ * The rest of CGI, such as SCRIPT_NAME and REQUEST_METHOD, and upload paths
+ * are the server's, and are left alone.
  */
 void Vision::define_input(Context& context) const {
 
-	context.head_mode = head_mode;
-	context.indent_mode = indent_mode;
-	context.pedantic_mode = pedantic_mode;
-	context.silent_mode = silent_mode;
-	context.tab_size = tab_size;
+	const auto text = [this](const std::string& value) {
+		return Reference<const Expression>(new Content(0, 0,
+			input_escape ? input_escape(value) : value));
+	};
+
+	const auto from_client = [](const std::string& name) {
+		return name.compare(0, 5, "HTTP_") == 0 || name == "CONTENT_TYPE"
+			|| name == "PATH_INFO" || name == "QUERY_STRING";
+	};
 
 	auto request_method = cgi.find("REQUEST_METHOD");
 	context.enter_scope(request_method->second);
 	for (auto i = input.begin(); i != input.end(); ++i)
-		context.define(Signature(i->first), std::shared_ptr<const Expression>
-			(new Content(0, 0, i->second)));
+		context.define(Signature(i->first), text(i->second));
+	if (query) {
+		std::shared_ptr<Query> provider = query;
+		context.provide([provider](Symbol name) {
+			return (*provider)(name);
+		});
+	}
+	if (json)
+		json->define(context, input_escape);
 	context.exit_scope();
 
 	context.enter_scope("CGI");
 	for (auto i = cgi.begin(); i != cgi.end(); ++i)
-		context.define(Signature(i->first), std::shared_ptr<const Expression>
+		context.define(Signature(i->first), from_client(i->first)
+			? text(i->second) : Reference<const Expression>
 			(new Content(0, 0, i->second)));
-	context.define(Signature("CONTENT_LENGTH"), std::shared_ptr<const Expression>
+	context.define(Signature("CONTENT_LENGTH"), Reference<const Expression>
 		(new Data(0, 0, content_length)));
 	context.exit_scope();
 
+	if (!form) return;
+
+	// FILES::field::path, ::size, ::name, and ::type for each upload.
+	const auto& uploads = form->get_uploads();
+	context.enter_scope("FILES");
+	for (auto i = uploads.begin(); i != uploads.end(); ++i) {
+		context.enter_scope(i->first);
+		context.define(Signature("path"), Reference<const Expression>
+			(new Content(0, 0, i->second.path)));
+		context.define(Signature("size"), Reference<const Expression>
+			(new Data(0, 0, i->second.size)));
+		context.define(Signature("name"), text(i->second.filename));
+		context.define(Signature("type"), text(i->second.type));
+		context.exit_scope();
+	}
+	context.exit_scope();
+
 }
 
 
@@ -293,24 +562,22 @@ void Vision::define_input(Context& context) const {
  */
 void Vision::run() const try {
 
-	if (filename == "-") {
-
-		const Scanner scanner(std::cin);
-		const Parser parser(scanner);
-		Interpreter interpreter(parser, std::cout);
-		define_input(interpreter.context);
+	Output output(STDOUT_FILENO);
+	std::ostream stream(&output);
+
+	std::ifstream file;
+	if (filename != "-")
+		file.open(filename.c_str(), std::ios::binary);
+	const Scanner scanner(filename == "-" ? std::cin : file);
+	const Parser parser(scanner);
+	Interpreter interpreter(parser, stream);
+	configure(interpreter.context);
+	define_prelude(interpreter.context);
+	define_input(interpreter.context);
+	if (records.empty())
 		interpreter.run();
-
-	} else {
-
-		std::ifstream file(filename.c_str(), std::ios::binary);
-		const Scanner scanner(file);
-		const Parser parser(scanner);
-		Interpreter interpreter(parser, std::cout);
-		define_input(interpreter.context);
-		interpreter.run();
-
-	}
+	else
+		run_batch(interpreter, output, stream);
 
 } catch (const std::runtime_error& exception) {
 
@@ -320,3 +587,138 @@ void Vision::run() const try {
 	throw std::runtime_error(message.str());
 
 }
+
+
+/**
+ * Render the template once for each of a batch of records, defined in the
+ * RECORD namespace. The template is parsed only once, and every record starts
+ * from a snapshot taken after the prelude and input were defined, so each
+ * renders exactly as it would in a run of its own. Records are written to
+ * files named by their number in the output directory, or else one after
+ * another to the output, each followed by a NUL.
+ *
+ * With -j, contiguous runs of records are rendered by separate processes, each
+ * into a temporary file, and the files are sent on in order.
+ */
+void Vision::run_batch(Interpreter& interpreter, Output& output,
+	std::ostream& stream) const {
+
+	const Batch batch(records);
+	const Reference<const Expression> program = interpreter.parse();
+	Context& context = interpreter.context;
+	const Context::Snapshot snapshot = context.snapshot();
+
+	const auto render = [&](std::size_t begin, std::size_t end,
+		std::ostream& out) {
+		for (std::size_t i = begin; i < end; ++i) {
+			try {
+				context.restore(snapshot);
+				context.enter_scope("RECORD");
+				batch.define(i, context, input_escape);
+				context.exit_scope();
+				if (output_directory.empty()) {
+					interpreter.render(*program, out);
+					out << '\0';
+					continue;
+				}
+				std::ostringstream path;
+				path << output_directory << '/' << i + 1;
+				std::ofstream file(path.str().c_str(), std::ios::binary);
+				if (!file.is_open())
+					throw std::runtime_error("Unable to open output \""
+						+ path.str() + "\".");
+				interpreter.render(*program, file);
+				file.close();
+				if (!file)
+					throw std::runtime_error("Unable to write output \""
+						+ path.str() + "\".");
+			} catch (const std::runtime_error& exception) {
+				std::ostringstream message;
+				message << "In record " << i + 1 << ":\n" << exception.what();
+				throw std::runtime_error(message.str());
+			}
+		}
+	};
+
+	const std::size_t count = batch.size();
+	const std::size_t workers = std::min<std::size_t>(std::max(jobs, 1),
+		std::max<std::size_t>(count, 1));
+	if (workers == 1) {
+		render(0, count, stream);
+		return;
+	}
+
+	// Anything still buffered would otherwise be written by every worker.
+	stream.flush();
+
+	const std::string temporary = environment_string("TMPDIR").empty()
+		? "/tmp" : environment_string("TMPDIR");
+	std::vector<std::string> paths;
+	std::vector<pid_t> children;
+	std::string error;
+
+	for (std::size_t worker = 0; worker < workers; ++worker) {
+
+		int descriptor = -1;
+		if (output_directory.empty()) {
+			std::string path = temporary + "/vision-batch-XXXXXX";
+			if ((descriptor = mkstemp(&path[0])) == -1) {
+				error = "Unable to create batch output in \"" + temporary
+					+ "\".";
+				break;
+			}
+			paths.push_back(path);
+		}
+
+		const pid_t child = fork();
+		if (child == -1) {
+			if (descriptor != -1) close(descriptor);
+			error = "Unable to start batch worker.";
+			break;
+		}
+
+		if (child == 0) {
+			int status = 0;
+			try {
+				const std::size_t begin = count * worker / workers;
+				const std::size_t end = count * (worker + 1) / workers;
+				if (descriptor == -1) {
+					render(begin, end, stream);
+				} else {
+					Output file(descriptor);
+					std::ostream out(&file);
+					render(begin, end, out);
+					if (!out.flush()) status = 1;
+				}
+			} catch (const std::exception& exception) {
+				std::cerr << exception.what() << '\n';
+				status = 1;
+			}
+			_exit(status);
+		}
+
+		if (descriptor != -1) close(descriptor);
+		children.push_back(child);
+
+	}
+
+	for (auto child = children.begin(); child != children.end(); ++child) {
+		int status;
+		while (waitpid(*child, &status, 0) == -1 && errno == EINTR) {}
+		if (error.empty() && (!WIFEXITED(status) || WEXITSTATUS(status)))
+			error = "A batch worker failed.";
+	}
+
+	for (auto path = paths.begin(); path != paths.end(); ++path) {
+		if (error.empty()) {
+			const auto mapping = Mapping::open(*path);
+			if (!mapping || !output.send(*mapping))
+				error = "Unable to send batch output.";
+		}
+		unlink(path->c_str());
+	}
+
+	if (!error.empty())
+		throw std::runtime_error(error);
+
+}
@@ -1,10 +1,17 @@
 #ifndef VISION_H
 #define VISION_H
+#include <iosfwd>
 #include <map>
+#include <memory>
 #include <string>
 
 
 class Context;
+class Interpreter;
+class Json;
+class Multipart;
+class Output;
+class Query;
 
 
 /**
@@ -16,6 +23,7 @@ class Vision {
 public:
 
 	Vision(int, char**);
+	~Vision();
 	void run() const;
 
 	enum OutputFormat {
@@ -28,20 +36,37 @@ private:
 
 	void parse_options(int, char**);
 	void parse_environment();
-	void decode_variables(const std::string&);
+	void read_body();
+	void configure(Context&) const;
+	void define_prelude(Context&) const;
 	void define_input(Context&) const;
+	void run_batch(Interpreter&, Output&, std::ostream&) const;
 
 	std::string filename;
+	std::string prelude;
 	OutputFormat output_format;
+	bool direct_mode;
 	bool indent_mode;
 	bool pedantic_mode;
 	bool silent_mode;
 	bool head_mode;
 	int tab_size;
+	int concurrency;
+	std::string (*input_escape)(const std::string&);
+	std::string records;
+	std::string output_directory;
+	int jobs;
+	std::string cache_directory;
+	std::string cache_version;
+	long cache_lifetime;
+	long cache_size;
 
-	int content_length;
+	long content_length;
 	std::map<std::string, std::string> cgi;
 	std::map<std::string, std::string> input;
+	std::unique_ptr<Multipart> form;
+	std::unique_ptr<const Json> json;
+	std::shared_ptr<Query> query;
 
 };
 
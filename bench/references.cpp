@@ -0,0 +1,74 @@
+#include "../Reference.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+
+/**
+ * A benchmark of the reference counting policy, on a workload shaped like
+ * evaluation: a tree is walked recursively, each call holding its node by
+ * value, and the results of every call are gathered into a vector of
+ * references, as Blocks gather Lists. The same walk is timed with Reference
+ * and with std::shared_ptr. Build it once plain and once with
+ * VISION_ATOMIC_REFERENCES, as references.sh does, to compare the two
+ * Counted policies.
+ */
+namespace {
+
+	const int depth = 12;
+	const int breadth = 3;
+	const int rounds = 20;
+
+	struct Node : Counted {
+		std::vector<Reference<const Node>> children;
+	};
+
+	struct Shared {
+		std::vector<std::shared_ptr<const Shared>> children;
+	};
+
+	template<class Pointer, class Type>
+	Pointer build(int level) {
+		Type* node = new Type();
+		for (int i = 0; level && i < breadth; ++i)
+			node->children.push_back(build<Pointer, Type>(level - 1));
+		return Pointer(node);
+	}
+
+	template<class Pointer>
+	long walk(Pointer node, std::vector<Pointer>& results) {
+		long count = 1;
+		for (auto i = node->children.begin(); i != node->children.end(); ++i)
+			count += walk(*i, results);
+		results.push_back(node);
+		return count;
+	}
+
+	template<class Pointer, class Type>
+	double time(const char* name) {
+		const Pointer root = build<Pointer, Type>(depth);
+		long count = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < rounds; ++round) {
+			std::vector<Pointer> results;
+			count += walk(root, results);
+		}
+		const std::chrono::duration<double> elapsed =
+			std::chrono::steady_clock::now() - start;
+		std::printf("%-18s %8.3fs (%ld nodes)\n", name, elapsed.count(),
+			count);
+		return elapsed.count();
+	}
+
+}
+
+
+int main() {
+#ifdef VISION_ATOMIC_REFERENCES
+	time<Reference<const Node>, Node>("Reference, atomic");
+#else
+	time<Reference<const Node>, Node>("Reference");
+#endif
+	time<std::shared_ptr<const Shared>, Shared>("std::shared_ptr");
+}
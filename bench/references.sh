@@ -0,0 +1,12 @@
+#!/bin/sh
+# Build the reference counting benchmark with each Counted policy and run
+# both. Set CXX to choose the compiler, and CXXFLAGS to add to its options.
+set -e
+cd "$(dirname "$0")"
+CXX=${CXX:-c++}
+OUT=${TMPDIR:-/tmp}
+$CXX -std=c++11 -O2 $CXXFLAGS -o "$OUT/vision-references" references.cpp
+$CXX -std=c++11 -O2 $CXXFLAGS -DVISION_ATOMIC_REFERENCES \
+	-o "$OUT/vision-references-atomic" references.cpp
+"$OUT/vision-references"
+"$OUT/vision-references-atomic"
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Check that the limit on form fields held in memory covers all the fields of
+# a multipart/form-data request together, not just each one. Set VISION to the
+# interpreter to test.
+set -e
+VISION=${VISION:-vision}
+OUT=$(mktemp -d "${TMPDIR:-/tmp}/vision-multipart-XXXXXX")
+trap 'rm -rf "$OUT"' EXIT
+: > "$OUT/empty.vis"
+
+# A body of the given number of fields, each just under the 1 MB field limit.
+body() {
+	field=$(head -c 1000000 /dev/zero | tr '\0' x)
+	i=0
+	while [ $i -lt $1 ]; do
+		printf -- '--limit\r\nContent-Disposition: form-data; name="f%d"\r\n' $i
+		printf '\r\n%s\r\n' "$field"
+		i=$((i + 1))
+	done
+	printf -- '--limit--\r\n'
+}
+
+# Post the body of the given number of fields, and say how that went.
+post() {
+	body $1 > "$OUT/body"
+	REQUEST_METHOD=POST \
+	CONTENT_TYPE='multipart/form-data; boundary=limit' \
+	CONTENT_LENGTH=$(wc -c < "$OUT/body") \
+	"$VISION" "$OUT/empty.vis" < "$OUT/body" > "$OUT/output" 2>&1 \
+		&& echo passed || echo failed
+}
+
+status=0
+
+if [ "$(post 60)" != passed ]; then
+	echo "60 MB of fields were refused:"
+	cat "$OUT/output"
+	status=1
+fi
+
+if [ "$(post 70)" != failed ] \
+	|| ! grep -q "Form fields are too large." "$OUT/output"; then
+	echo "70 MB of fields were not refused:"
+	head -c 1000 "$OUT/output"
+	status=1
+fi
+
+exit $status